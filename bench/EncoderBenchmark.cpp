@@ -0,0 +1,85 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "EncoderProfile.hpp"
+#include "FFmpegUtils.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <magic_enum.hpp>
+#include <fmt/format.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using seconds = std::chrono::duration<double>;
+namespace fs = std::filesystem;
+
+// A dim, noisy sky with a flash partway through, which is about what the
+// encoder sees in practice
+std::vector<cv::Mat> MakeFrames(cv::Size size, size_t count)
+{
+  std::vector<cv::Mat> frames;
+  cv::Mat sky(size, CV_8UC3);
+  for (int row = 0; row < size.height; ++row)
+    sky.row(row).setTo(cv::Scalar::all(20 + 40 * row / size.height));
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    cv::Mat noise(size, CV_8UC3);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(8));
+    cv::Mat frame = sky + noise;
+    if (i >= count / 2 && i < count / 2 + 3)
+      cv::circle(frame, cv::Point(size.width / 3, size.height / 4), size.height / 6, cv::Scalar::all(255), cv::FILLED);
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+int main(int argc, char** argv)
+{
+  const cv::Size size(argc > 2 ? std::stoi(argv[1]) : 1920, argc > 2 ? std::stoi(argv[2]) : 1080);
+  const size_t count = argc > 3 ? std::stoul(argv[3]) : 150;
+  const AVRational fps = NearestRational(30);
+  av_log_set_level(AV_LOG_ERROR);
+
+  fmt::print("Encoding {} frames at {}x{}\n\n", count, size.width, size.height);
+  fmt::print("{:<10} {:>10} {:>10} {:>12}\n", "profile", "seconds", "fps", "size (KB)");
+
+  auto frames = MakeFrames(size, count);
+  for (const auto& [profile, name] : magic_enum::enum_entries<EncoderProfile>())
+  {
+    fs::path output = fs::temp_directory_path() / fmt::format("stormwatch-encoder-benchmark-{}.webm", name);
+    auto start = std::chrono::steady_clock::now();
+    {
+      ffmpegcpp::Muxer muxer(output.string());
+      // One encode at a time, so each gets every core it can use
+      auto codec = MakeCodec(profile, size, fps, 1);
+      ffmpegcpp::VideoEncoder encoder(codec.get(), &muxer, fps, AV_PIX_FMT_YUV420P);
+      ffmpegcpp::RawVideoDataSource source(size.width, size.height, AV_PIX_FMT_BGR24, fps, &encoder);
+      for (const auto& frame : frames)
+        source.WriteFrame(frame.data, int(frame.step[0]));
+      source.Close();
+    }
+    seconds elapsed = std::chrono::steady_clock::now() - start;
+    fmt::print("{:<10} {:>10.2f} {:>10.1f} {:>12.0f}\n", name, elapsed.count(), count / elapsed.count(), fs::file_size(output) / 1024.0);
+    fs::remove(output);
+  }
+
+  return 0;
+}
\ No newline at end of file
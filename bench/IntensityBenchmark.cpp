@@ -0,0 +1,121 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Intensity.hpp"
+#include "FrameDifference.hpp"
+
+#include <opencv2/core.hpp>
+#include <fmt/format.h>
+#include <chrono>
+#include <vector>
+
+using seconds = std::chrono::duration<double>;
+
+// Runs fn over and over for roughly half a second; returns seconds per call
+template<typename F>
+double Time(F&& fn)
+{
+  volatile double sink = 0;
+  size_t iterations = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = seconds(0);
+  do
+  {
+    sink = sink + fn();
+    ++iterations;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.5);
+  return elapsed.count() / iterations;
+}
+
+int main()
+{
+  const std::vector<std::pair<const char*, cv::Size>> resolutions =
+  {
+    { "720p",  cv::Size(1280, 720) },
+    { "1080p", cv::Size(1920, 1080) },
+    { "4K",    cv::Size(3840, 2160) }
+  };
+
+  fmt::print("MeanIntensity kernel: {}\n\n", IntensityKernelName());
+  fmt::print("{:<6} {:<12} {:>10} {:>12} {:>10}\n", "size", "method", "ms/frame", "GB/s", "frames/s");
+
+  for (const auto& [name, size] : resolutions)
+  {
+    cv::Mat frame(size, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    const double frameBytes = double(frame.total() * frame.elemSize());
+
+    double baseline = Time([&]()
+    {
+      cv::Scalar mean = cv::mean(frame);
+      return (mean[0] + mean[1] + mean[2]) / 3;
+    });
+    fmt::print("{:<6} {:<12} {:>10.3f} {:>12.2f} {:>10.0f}\n", name, "cv::mean", baseline * 1000, frameBytes / baseline / 1e9, 1 / baseline);
+
+    for (unsigned decimation : { 1u, 2u, 4u, 8u })
+    {
+      double perFrame = Time([&]() { return MeanIntensity(frame, decimation); });
+      // Throughput counts the bytes actually read, not the whole frame
+      fmt::print("{:<6} {:<12} {:>10.3f} {:>12.2f} {:>10.0f}\n",
+        name,
+        fmt::format("simd /{}", decimation),
+        perFrame * 1000,
+        frameBytes / decimation / perFrame / 1e9,
+        1 / perFrame);
+    }
+
+    std::vector<double> tiles;
+    for (cv::Size grid : { cv::Size(4, 3), cv::Size(16, 9) })
+    {
+      double perFrame = Time([&]() { TileIntensities(frame, grid, tiles); return tiles[0]; });
+      fmt::print("{:<6} {:<12} {:>10.3f} {:>12.2f} {:>10.0f}\n",
+        name,
+        fmt::format("tiles {}x{}", grid.width, grid.height),
+        perFrame * 1000,
+        frameBytes / perFrame / 1e9,
+        1 / perFrame);
+    }
+
+    cv::Mat other(size, CV_8UC3);
+    cv::randu(other, cv::Scalar::all(0), cv::Scalar::all(255));
+    for (unsigned scale : { 1u, 4u, 8u })
+    {
+      FrameDifference difference(scale);
+      bool flip = false;
+      double perFrame = Time([&]()
+      {
+        flip = !flip;
+        difference.Update(flip ? frame : other, cv::Size(1, 1), tiles);
+        return tiles[0];
+      });
+      fmt::print("{:<6} {:<12} {:>10.3f} {:>12.2f} {:>10.0f}\n",
+        name,
+        fmt::format("diff /{}", scale),
+        perFrame * 1000,
+        frameBytes / perFrame / 1e9,
+        1 / perFrame);
+    }
+
+    cv::Mat mosaic(size, CV_8UC1);
+    cv::randu(mosaic, cv::Scalar::all(0), cv::Scalar::all(255));
+    double bayer = Time([&]() { return MeanBayerIntensity(mosaic, true); });
+    fmt::print("{:<6} {:<12} {:>10.3f} {:>12.2f} {:>10.0f}\n", name, "bayer", bayer * 1000, double(mosaic.total()) / bayer / 1e9, 1 / bayer);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,393 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Camera.hpp"
+#include "FrameAnalyzer.hpp"
+#include "FrameRing.hpp"
+#include "CompressedFrameRing.hpp"
+#include "SegmentRecorder.hpp"
+#include "VideoLibrary.hpp"
+#include "OpenCVInit.hpp"
+#include "FFmpegInit.hpp"
+
+#include <opencv2/videoio.hpp>
+#include <opencv2/imgproc.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <nlohmann/json.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <magic_enum.hpp>
+#include <fmt/format.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs recorded video through the capture pipeline (Bayer mosaic, brightness
+// and trigger, frame history, clip saving) with a single thread and without
+// dropping frames (saves still encoding make the ring borrow frames, never
+// skip them), so the same file and settings always trigger on the same
+// frames.  Reports how fast each stage went, where the trigger fired and
+// what got saved.
+
+using json = nlohmann::json;
+using seconds = std::chrono::duration<double>;
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+// Which of B, G, R (as channel indices) each site of a 2x2 superpixel holds,
+// top row first, in OpenCV's naming (which is offset by one pixel)
+constexpr int BAYER_SITES[4][2][2] =
+{
+  { { 2, 1 }, { 1, 0 } }, // BG
+  { { 1, 2 }, { 0, 1 } }, // GB
+  { { 0, 1 }, { 1, 2 } }, // RG
+  { { 1, 0 }, { 2, 1 } }  // GR
+};
+
+// Turns a colour frame back into what a Bayer sensor would have delivered,
+// so the demosaic path runs as it would on a camera
+void MakeMosaic(const cv::Mat& bgr, BayerMode mode, cv::Mat& mosaic)
+{
+  const auto& sites = BAYER_SITES[int(mode) - 1];
+  mosaic.create(bgr.size(), CV_8UC1);
+  for (int row = 0; row < bgr.rows; ++row)
+  {
+    const uchar* source = bgr.ptr(row);
+    uchar* destination = mosaic.ptr(row);
+    for (int column = 0; column < bgr.cols; ++column)
+      destination[column] = source[column * 3 + sites[row % 2][column % 2]];
+  }
+}
+
+struct StageTime
+{
+  const char* name;
+  seconds elapsed{ 0 };
+};
+
+template <typename Work>
+void Time(StageTime& stage, Work&& work)
+{
+  auto start = std::chrono::steady_clock::now();
+  work();
+  stage.elapsed += std::chrono::steady_clock::now() - start;
+}
+
+struct Capture
+{
+  size_t frame;
+  size_t peak;
+  // Unset when only detecting
+  std::optional<VideoID> id;
+};
+
+struct ReplayResult
+{
+  std::string source;
+  size_t frames = 0;
+  double fps = 0;
+  seconds wall{ 0 };
+  std::vector<StageTime> stages;
+  std::vector<Capture> captures;
+};
+
+std::optional<ReplayResult> Replay(const std::string& source, const std::map<CameraProperty, double>& properties, std::optional<BayerMode> bayerMode, double fpsOverride, bool realtime, const fs::path& segmentPath, bool save, VideoLibrary& library)
+{
+  cv::VideoCapture cap(source);
+  if (!cap.isOpened())
+  {
+    spdlog::get("camera")->critical("Unable to open {}", source);
+    return std::nullopt;
+  }
+
+  auto property = [&](CameraProperty key) { return properties.at(key); };
+  ReplayResult result;
+  result.source = source;
+  result.fps = fpsOverride > 0 ? fpsOverride : cap.get(cv::CAP_PROP_FPS);
+  if (result.fps <= 0)
+    result.fps = 30;
+  cv::Size resolution(cap.get(cv::CAP_PROP_FRAME_WIDTH), cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+
+  // Sized the same way Camera::Run sizes them
+  auto recordingMode = magic_enum::enum_cast<RecordingMode>(property(CameraProperty::RecordingMode)).value_or(RecordingMode::Raw);
+  auto encoderProfile = magic_enum::enum_cast<EncoderProfile>(property(CameraProperty::EncoderProfile)).value_or(EncoderProfile::Fast);
+  size_t clipFrames = std::max<size_t>(1, property(CameraProperty::ClipLengthSeconds) * result.fps);
+  size_t spareFrames = std::max<size_t>(2, result.fps);
+  std::unique_ptr<FrameHistory> frames;
+  std::unique_ptr<SegmentRecorder> recorder;
+  switch (recordingMode)
+  {
+  default:
+  case RecordingMode::Raw:
+    frames = std::make_unique<FrameRing>(resolution, CV_8UC3, clipFrames, spareFrames);
+    break;
+  case RecordingMode::Compressed:
+    frames = std::make_unique<CompressedFrameRing>(resolution, CV_8UC3, clipFrames, std::clamp(int(property(CameraProperty::CompressionQuality)), 1, 100));
+    break;
+  case RecordingMode::Segmented:
+    frames = std::make_unique<FrameRing>(resolution, CV_8UC3, std::max<size_t>(1, (property(CameraProperty::TriggerDelay) + 1) * result.fps),
+      spareFrames + SegmentRecorder::GetQueueLimit(result.fps));
+    if (save)
+      recorder = std::make_unique<SegmentRecorder>(
+        segmentPath,
+        resolution,
+        result.fps,
+        std::max(0.5, property(CameraProperty::SegmentSeconds)),
+        property(CameraProperty::ClipLengthSeconds),
+        encoderProfile,
+        library.GetEncodeConcurrency());
+    break;
+  }
+
+  FrameAnalyzer analyzer(resolution, bayerMode, result.fps, clipFrames);
+  analyzer.Configure(property);
+
+  StageTime decode{ "decode" }, mosaic{ "mosaic" }, measure{ "measure" }, convert{ "convert" }, trigger{ "trigger" }, submit{ "submit" };
+  cv::Mat grabbed;
+  cv::Mat raw;
+  auto start = std::chrono::steady_clock::now();
+  while (true)
+  {
+    // Frames come off the file no faster than the camera would deliver them
+    if (realtime)
+      std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(seconds(result.frames / result.fps)));
+
+    bool read = false;
+    Time(decode, [&] { read = cap.read(grabbed); });
+    if (!read || grabbed.empty())
+      break;
+
+    // Stand in for what the camera would have handed over
+    Time(mosaic, [&]
+    {
+      if (grabbed.channels() == 1 && !bayerMode)
+        cv::cvtColor(grabbed, raw, cv::COLOR_GRAY2BGR);
+      else if (grabbed.channels() == 3 && bayerMode)
+        MakeMosaic(grabbed, bayerMode.value(), raw);
+      else
+      {
+        // Traded rather than shared; raw's buffer may end up in the ring,
+        // where the next decode must not write over it
+        std::swap(raw, grabbed);
+      }
+    });
+
+    Time(measure, [&] { analyzer.Measure(raw); });
+    bool committed = false;
+    Time(convert, [&]
+    {
+      committed = CommitFrame(raw, bayerMode, resolution, *frames);
+      if (committed && recorder)
+        recorder->Push(frames->PinNewest());
+    });
+    ++result.frames;
+    // The ring has already said why (a size mismatch, or no memory left to
+    // borrow frames from); the trigger sees the frame all the same, as it
+    // does in the camera
+    if (!committed)
+      spdlog::get("camera")->warn("Frame {} was not buffered", result.frames - 1);
+
+    bool capture = false;
+    Time(trigger, [&] { capture = analyzer.ShouldCapture(); });
+    if (capture)
+    {
+      size_t frame = result.frames - 1;
+      size_t peakSeekBack = analyzer.GetPeakSeekBack();
+      size_t peak = frame + 1 >= peakSeekBack ? frame + 1 - peakSeekBack : 0;
+      Time(submit, [&]
+      {
+        std::optional<VideoID> id;
+        if (save && recorder)
+          id = library.SaveSegments(0, recorder->Cut(), frames->Snapshot(), peakSeekBack, analyzer.GetTrace());
+        else if (save)
+          id = library.SaveClip(0, frames->Snapshot(), result.fps, encoderProfile, peakSeekBack, analyzer.GetTrace());
+        result.captures.push_back({ frame, peak, id });
+      });
+      spdlog::get("camera")->info("Trigger at frame {} ({:.2f}s), peak at frame {} ({:.2f}s)", frame, frame / result.fps, peak, peak / result.fps);
+    }
+  }
+  result.wall = std::chrono::steady_clock::now() - start;
+  result.stages = { decode, mosaic, measure, convert, trigger, submit };
+  return result;
+}
+
+// Every clip file that made it to disk, and how big it is
+json DescribeClip(const fs::path& libraryPath, const VideoID& id)
+{
+  json files = json::object();
+  for (const auto& path : ClipIndex::GetClipFiles(libraryPath, id))
+  {
+    std::error_code error;
+    auto size = fs::file_size(path, error);
+    if (!error)
+      files[path.filename().string().substr(id.GetID().size())] = size;
+  }
+  return files;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> inputs;
+  std::string settingsPath;
+  std::string outputPath;
+  std::string reportPath;
+  std::string bayer;
+  double fps;
+  bool realtime;
+  bool detectOnly;
+  bool verbose;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "show help message")
+    ("input", po::value(&inputs), "video files to replay, one after another")
+    ("settings", po::value(&settingsPath), "camera settings file to replay with (as saved by stormwatch); defaults otherwise")
+    ("output", po::value(&outputPath)->default_value((fs::temp_directory_path() / "stormwatch-replay").string()), "directory to save clips under")
+    ("report", po::value(&reportPath), "also write the results to this file as JSON")
+    ("bayer", po::value(&bayer), "turn colour frames into a mosaic of this layout (BG, GB, RG or GR) to run the demosaic path; single channel input is taken as a mosaic already")
+    ("fps", po::value(&fps)->default_value(0), "frame rate to assume when the file doesn't give one")
+    ("realtime", po::bool_switch(&realtime)->default_value(false), "pace frames at the file's frame rate instead of as fast as possible")
+    ("detect-only", po::bool_switch(&detectOnly)->default_value(false), "run the trigger but don't save clips")
+    ("verbose", po::bool_switch(&verbose)->default_value(false), "verbose logging")
+  ;
+  po::positional_options_description positional;
+  positional.add("input", -1);
+
+  po::variables_map v;
+  po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), v);
+  po::notify(v);
+
+  if (v.count("help") || inputs.empty())
+  {
+    std::cout << "Usage: stormwatch-replay [options] video..." << std::endl << desc << std::endl;
+    return 1;
+  }
+
+  std::optional<BayerMode> bayerMode;
+  if (!bayer.empty())
+  {
+    bayerMode = magic_enum::enum_cast<BayerMode>(bayer);
+    if (!bayerMode)
+    {
+      std::cout << "unknown Bayer layout " << bayer << std::endl;
+      return 1;
+    }
+  }
+
+  spdlog::set_level(verbose ? spdlog::level::trace : spdlog::level::info);
+  spdlog::stdout_color_mt("opencv");
+  spdlog::stdout_color_mt("camera");
+  spdlog::stdout_color_mt("library");
+  spdlog::stdout_color_mt("ffmpeg");
+  spdlog::stdout_color_mt("settings");
+  SetupOpenCVLogging();
+  SetupFFmpegLogging();
+
+  auto properties = Camera::GetDefaultProperties();
+  if (!settingsPath.empty())
+  {
+    try
+    {
+      json settings;
+      std::ifstream settingsFile(settingsPath, std::ios_base::binary);
+      settingsFile >> settings;
+      for (const auto& prop : CameraPropertyEntries)
+        if (settings.contains(prop.second))
+          properties[prop.first] = settings[std::string(prop.second)];
+    }
+    catch (json::exception& e)
+    {
+      std::cout << "error parsing settings: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // Nothing dropped or merged, and nothing evicted (the default retention
+  // policy never does), so every trigger ends up as a clip
+  EncodeBudget budget;
+  budget.policy = OverflowPolicy::Spill;
+  VideoLibrary library(budget, RetentionPolicy(), outputPath);
+  const fs::path libraryPath = fs::path(outputPath) / "videolib";
+
+  std::vector<ReplayResult> results;
+  for (const auto& input : inputs)
+  {
+    auto result = Replay(input, properties, bayerMode, fps, realtime, fs::path(outputPath) / "segments", !detectOnly, library);
+    if (!result)
+      return 1;
+    results.push_back(std::move(result.value()));
+  }
+
+  // Clips are still encoding; the time until they're all done is the save
+  // stage's share
+  auto drainStart = std::chrono::steady_clock::now();
+  for (auto status = library.GetEncodeStatus(); status.queued != 0 || status.running != 0; status = library.GetEncodeStatus())
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  seconds drain = std::chrono::steady_clock::now() - drainStart;
+
+  json report = json::array();
+  for (const auto& result : results)
+  {
+    fmt::print("\n{}: {} frames at {:.2f} fps, {:.2f}s ({:.1f} fps overall)\n",
+      result.source, result.frames, result.fps, result.wall.count(), result.frames / std::max(result.wall.count(), 1e-9));
+    fmt::print("{:<10} {:>10} {:>12}\n", "stage", "seconds", "frames/s");
+    json stages = json::object();
+    for (const auto& stage : result.stages)
+    {
+      double rate = stage.elapsed.count() > 0 ? result.frames / stage.elapsed.count() : 0;
+      fmt::print("{:<10} {:>10.3f} {:>12.1f}\n", stage.name, stage.elapsed.count(), rate);
+      stages[stage.name] = { { "seconds", stage.elapsed.count() }, { "fps", rate } };
+    }
+
+    fmt::print("{} triggers\n", result.captures.size());
+    json captures = json::array();
+    for (const auto& capture : result.captures)
+    {
+      json clip = { { "frame", capture.frame }, { "time", capture.frame / result.fps }, { "peak", capture.peak } };
+      fmt::print("  frame {:>7} ({:>8.2f}s) peak {:>7}", capture.frame, capture.frame / result.fps, capture.peak);
+      if (capture.id)
+      {
+        clip["id"] = capture.id->GetID();
+        clip["files"] = DescribeClip(libraryPath, capture.id.value());
+        fmt::print("  {} {}", capture.id->GetID(), clip["files"].dump());
+      }
+      fmt::print("\n");
+      captures.push_back(std::move(clip));
+    }
+    report.push_back(
+      {
+        { "source", result.source },
+        { "frames", result.frames },
+        { "fps", result.fps },
+        { "seconds", result.wall.count() },
+        { "stages", std::move(stages) },
+        { "captures", std::move(captures) }
+      });
+  }
+  if (!detectOnly)
+    fmt::print("\nEncoding finished {:.2f}s after the last frame; clips are in {}\n", drain.count(), libraryPath.string());
+
+  if (!reportPath.empty())
+    std::ofstream(reportPath) << json({ { "replays", report }, { "encodeDrainSeconds", drain.count() } }).dump(2) << std::endl;
+  return 0;
+}
\ No newline at end of file
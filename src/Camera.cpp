@@ -22,8 +22,17 @@
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <chrono>
 
 #include "Platform.hpp"
+#include "FrameRing.hpp"
+#include "CompressedFrameRing.hpp"
+#include "SegmentRecorder.hpp"
+#include "FrameAnalyzer.hpp"
+#include "SPSCQueue.hpp"
 
 #ifdef WINDOWS
 #define ATOMIC_FLAG_INIT
@@ -31,15 +40,28 @@
 
 using json = nlohmann::json;
 
-Camera::Camera(VideoLibrary& videoLibrary)
-  : library(videoLibrary),
+Camera::Camera(VideoLibrary& videoLibrary, uint16_t number, const std::string& source)
+  : NUMBER(number),
+    NAME(std::to_string(number)),
+    SOURCE(source),
+    // Same sinks as the shared camera logger, but every line says which camera
+    log(spdlog::get("camera")->clone(fmt::format("camera {}", NAME))),
+    library(videoLibrary),
     abort(ATOMIC_FLAG_INIT),
     applySettings(ATOMIC_FLAG_INIT)
 {
   abort.clear();
   applySettings.clear();
 
-  properties = std::map<CameraProperty, double>(
+  properties.object = GetDefaultProperties();
+
+  LoadSettings();
+  ApplyPropertyChange();
+}
+
+std::map<CameraProperty, double> Camera::GetDefaultProperties()
+{
+  return
   {
     { CameraProperty::EdgeDetectionSeconds, 2.0 },
     { CameraProperty::DebounceSeconds, 1.0 },
@@ -48,11 +70,22 @@ Camera::Camera(VideoLibrary& videoLibrary)
     { CameraProperty::ClipLengthSeconds, 30.0 },
     { CameraProperty::BayerMode, 0.0 },
     { CameraProperty::Width, 0.0 },
-    { CameraProperty::Height, 0.0 }
-  });
-
-  LoadSettings();
-  ApplyPropertyChange();
+    { CameraProperty::Height, 0.0 },
+    { CameraProperty::HugePages, 0.0 },
+    { CameraProperty::RecordingMode, 0.0 },
+    { CameraProperty::CompressionQuality, 90.0 },
+    { CameraProperty::SegmentSeconds, 2.0 },
+    { CameraProperty::AnalysisDecimation, 1.0 },
+    { CameraProperty::TriggerMode, 0.0 },
+    { CameraProperty::ZScoreThreshold, 6.0 },
+    { CameraProperty::TileColumns, 1.0 },
+    { CameraProperty::TileRows, 1.0 },
+    { CameraProperty::DetectorMode, 0.0 },
+    { CameraProperty::DifferenceScale, 4.0 },
+    { CameraProperty::EncoderProfile, 1.0 },
+    { CameraProperty::PreviewRate, 2.0 },
+    { CameraProperty::PreviewWidth, 640.0 }
+  };
 }
 
 Camera::~Camera()
@@ -61,9 +94,27 @@ Camera::~Camera()
     Stop();
 }
 
+const std::string& Camera::GetName() const
+{
+  return NAME;
+}
+
+const std::string& Camera::GetSource() const
+{
+  return SOURCE;
+}
+
+std::filesystem::path Camera::GetSettingsPath() const
+{
+  // The first camera keeps the file single camera setups already have
+  if (NAME == "0")
+    return GetConfigPath() / "settings.json";
+  return GetConfigPath() / fmt::format("settings-{}.json", NAME);
+}
+
 void Camera::LoadSettings()
 {
-  std::filesystem::path settingsPath = GetConfigPath() / "settings.json";
+  std::filesystem::path settingsPath = GetSettingsPath();
   if (std::filesystem::exists(settingsPath))
   {
     try
@@ -91,20 +142,23 @@ void Camera::SaveSettings()
   for (const auto& prop : CameraPropertyEntries)
     settings[std::string(prop.second)] = GetProperty(prop.first);
   
+  std::unique_lock lock(settingsFileMutex);
   if (!std::filesystem::exists(GetConfigPath()))
     std::filesystem::create_directories(GetConfigPath());
-  std::ofstream settingsFile(GetConfigPath() / "settings.json", std::ios_base::binary);
+  std::ofstream settingsFile(GetSettingsPath(), std::ios_base::binary);
   settingsFile << settings;
 }
 
 double Camera::GetProperty(CameraProperty property) const
 {
-  return properties.at(property);
+  std::shared_lock lock(properties.mutex);
+  return properties.object.at(property);
 }
 
 void Camera::SetProperty(CameraProperty property, double value)
 {
-  properties[property] = value;
+  std::unique_lock lock(properties.mutex);
+  properties.object[property] = value;
 }
 
 void Camera::ApplyPropertyChange()
@@ -113,29 +167,64 @@ void Camera::ApplyPropertyChange()
   applySettings.clear();
 }
 
-std::vector<uchar> GetDefaultImage()
+// Frames waiting between grab and conversion; at 30fps this is a quarter
+// second of slack before the grab loop starts dropping
+constexpr size_t CAPTURE_QUEUE_DEPTH = 8;
+constexpr size_t PREVIEW_QUEUE_DEPTH = 2;
+
+struct Camera::Pipeline
 {
-  std::vector<uchar> image;
-  cv::imencode(".jpg", cv::Mat(cv::Size(32, 32), CV_8UC3, cv::Scalar(0, 0, 0)), image);
+  Pipeline(std::unique_ptr<FrameHistory> frames, std::unique_ptr<SegmentRecorder> recorder, size_t clipFrames, std::optional<BayerMode> bayerMode, cv::Size resolution)
+    : frames(std::move(frames)),
+      recorder(std::move(recorder)),
+      clipFrames(clipFrames),
+      bayerMode(bayerMode),
+      resolution(resolution),
+      // One buffer in the grab loop, one in conversion, the rest queued
+      rawFrames(CAPTURE_QUEUE_DEPTH + 2),
+      captured(CAPTURE_QUEUE_DEPTH),
+      recycled(rawFrames.size()),
+      previews(PREVIEW_QUEUE_DEPTH),
+      running(true),
+      measuredFPS(0)
+  {
+  }
+
+  std::unique_ptr<FrameHistory> frames;
+  std::unique_ptr<SegmentRecorder> recorder;
+  // A whole clip, even when the frame history only holds enough to take
+  // stills from; the intensity trace covers this much
+  const size_t clipFrames;
+  const std::optional<BayerMode> bayerMode;
+  const cv::Size resolution;
+
+  std::vector<cv::Mat> rawFrames;
+  SPSCQueue<size_t> captured;
+  SPSCQueue<size_t> recycled;
+  SPSCQueue<std::shared_ptr<ClipFrames>> previews;
+  std::atomic<bool> running;
+  std::atomic<double> measuredFPS;
+};
+
+std::shared_ptr<const std::vector<uchar>> GetDefaultImage()
+{
+  auto image = std::make_shared<std::vector<uchar>>();
+  cv::imencode(".jpg", cv::Mat(cv::Size(32, 32), CV_8UC3, cv::Scalar(0, 0, 0)), *image);
   return image;
 }
 
-std::vector<uchar> Camera::GetPreview()
+PreviewImage Camera::GetPreview()
 {
-  static std::vector<uchar> defaultImage = GetDefaultImage();
+  static const auto defaultImage = GetDefaultImage();
 
-  std::vector<uchar> image;
   if (IsRunning())
   {
     std::shared_lock lock(preview.mutex);
-    if (!preview.object.empty())
-      cv::imencode(".jpg", preview.object, image);
-    else
-      image = defaultImage;
+    if (preview.object.jpeg)
+      return preview.object;
   }
-  else
-    image = defaultImage;
-  return image;
+  // Generation 0 is never handed out for a real frame
+  return { 0, defaultImage };
 }
 
 CameraStatus Camera::GetStatus()
@@ -146,70 +235,87 @@ CameraStatus Camera::GetStatus()
 
 void Camera::Start()
 {
-  double clipLengthSeconds = properties.at(CameraProperty::ClipLengthSeconds);
-  std::optional<BayerMode> bayerMode = magic_enum::enum_cast<BayerMode>(properties.at(CameraProperty::BayerMode));
-  auto width  = properties.at(CameraProperty::Width);
-  auto height = properties.at(CameraProperty::Height);
-  std::optional<cv::Size> requestedDimensions = (width > 0 && height > 0) ?
+  CaptureParameters parameters;
+  parameters.clipLengthSeconds = GetProperty(CameraProperty::ClipLengthSeconds);
+  parameters.bayerMode = magic_enum::enum_cast<BayerMode>(GetProperty(CameraProperty::BayerMode));
+  auto width  = GetProperty(CameraProperty::Width);
+  auto height = GetProperty(CameraProperty::Height);
+  parameters.requestedDimensions = (width > 0 && height > 0) ?
     std::optional<cv::Size>(cv::Size(width, height)) :
     std::nullopt;
+  parameters.hugePages = GetProperty(CameraProperty::HugePages) != 0;
+  parameters.recordingMode = magic_enum::enum_cast<RecordingMode>(GetProperty(CameraProperty::RecordingMode)).value_or(RecordingMode::Raw);
+  parameters.compressionQuality = std::clamp(int(GetProperty(CameraProperty::CompressionQuality)), 1, 100);
+  parameters.segmentSeconds = std::max(0.5, GetProperty(CameraProperty::SegmentSeconds));
+  parameters.triggerDelay = GetProperty(CameraProperty::TriggerDelay);
+  parameters.encoderProfile = magic_enum::enum_cast<EncoderProfile>(GetProperty(CameraProperty::EncoderProfile)).value_or(EncoderProfile::Fast);
   
-  spdlog::get("camera")->info("Requested camera start with following parameters");
-  spdlog::get("camera")->info("- Bayer Mode: {}", bayerMode ? magic_enum::enum_name<BayerMode>(bayerMode.value()) : "Disabled");
-  if (requestedDimensions)
-    spdlog::get("camera")->info("- Dimensions: {}x{}", requestedDimensions.value().width, requestedDimensions.value().height);
+  log->info("Requested camera start with following parameters");
+  log->info("- Bayer Mode: {}", parameters.bayerMode ? magic_enum::enum_name<BayerMode>(parameters.bayerMode.value()) : "Disabled");
+  if (parameters.requestedDimensions)
+    log->info("- Dimensions: {}x{}", parameters.requestedDimensions.value().width, parameters.requestedDimensions.value().height);
+  else
+    log->info("- Dimensions: auto");
+  log->info("- Huge Pages: {}", parameters.hugePages ? "Enabled" : "Disabled");
+  if (parameters.recordingMode == RecordingMode::Compressed)
+    log->info("- Recording Mode: {} (quality {})", magic_enum::enum_name<RecordingMode>(parameters.recordingMode), parameters.compressionQuality);
+  else if (parameters.recordingMode == RecordingMode::Segmented)
+    log->info("- Recording Mode: {} ({}s segments)", magic_enum::enum_name<RecordingMode>(parameters.recordingMode), parameters.segmentSeconds);
   else
-    spdlog::get("camera")->info("- Dimensions: auto");
+    log->info("- Recording Mode: {}", magic_enum::enum_name<RecordingMode>(parameters.recordingMode));
+  log->info("- Encoder Profile: {}", magic_enum::enum_name<EncoderProfile>(parameters.encoderProfile));
 
-  std::unique_lock(cameraThread.mutex);
+  std::unique_lock lock(cameraThread.mutex);
   if (cameraThread.object.get_id() == std::thread::id())
   {
     abort.test_and_set();
-    cameraThread.object = std::thread(&Camera::Run, this, clipLengthSeconds, bayerMode, requestedDimensions);
-    spdlog::get("camera")->info("Started camera");
+    cameraThread.object = std::thread(&Camera::Run, this, parameters);
+    log->info("Started camera");
   }
   else
-    spdlog::get("camera")->warn("Start request received but camera already started");
+    log->warn("Start request received but camera already started");
   
 }
 
 void Camera::Stop()
 {
-  std::unique_lock(cameraThread.mutex);
+  std::unique_lock lock(cameraThread.mutex);
   if (cameraThread.object.joinable())
   {
     abort.clear();
     cameraThread.object.join();
     cameraThread.object = std::thread();
-    spdlog::get("camera")->info("Stopped camera");
+    log->info("Stopped camera");
   }
   else
-    spdlog::get("camera")->warn("Stop request received but camera already stopped");
+    log->warn("Stop request received but camera already stopped");
 }
 
 bool Camera::IsRunning()
 {
-  std::unique_lock(cameraThread.mutex);
+  std::unique_lock lock(cameraThread.mutex);
   return cameraThread.object.get_id() != std::thread::id();
 }
 
-void Camera::Run(double clipLengthSeconds, std::optional<BayerMode> bayerMode, std::optional<cv::Size> requestedDimensions)
+void Camera::Run(CaptureParameters parameters)
 {
   cv::VideoCapture cap;
-  std::vector<cv::Mat> frames;
-  size_t frameIndex = 0;
+  const auto& bayerMode = parameters.bayerMode;
   
-  cap.open(0);
+  if (!SOURCE.empty() && std::all_of(SOURCE.begin(), SOURCE.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+    cap.open(std::stoi(SOURCE));
+  else
+    cap.open(SOURCE);
   if (!cap.isOpened())
   {
-    spdlog::get("camera")->critical("ERROR! Unable to open camera");
+    log->critical("ERROR! Unable to open camera {}", SOURCE);
     return;
   }
 
-  if (requestedDimensions)
+  if (parameters.requestedDimensions)
   {
-    cap.set(cv::CAP_PROP_FRAME_WIDTH,  requestedDimensions.value().width);
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, requestedDimensions.value().height);
+    cap.set(cv::CAP_PROP_FRAME_WIDTH,  parameters.requestedDimensions.value().width);
+    cap.set(cv::CAP_PROP_FRAME_HEIGHT, parameters.requestedDimensions.value().height);
   }
   if (bayerMode)
     cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
@@ -218,78 +324,206 @@ void Camera::Run(double clipLengthSeconds, std::optional<BayerMode> bayerMode, s
   status.object.resolution = cv::Size(cap.get(cv::CAP_PROP_FRAME_WIDTH), cap.get(cv::CAP_PROP_FRAME_HEIGHT));
   status.object.nominalFPS = propFPS == 0 ? 30 : propFPS;
 
-  size_t bufferSize = clipLengthSeconds * status.object.nominalFPS;
-  frames.reserve(bufferSize);
-  for (size_t i = 0; i < bufferSize; ++i)
-    frames.push_back(cv::Mat(status.object.resolution, CV_8UC3, cv::Scalar(0, 0, 0)));
-
-  while(abort.test_and_set())
+  size_t bufferSize = std::max<size_t>(1, parameters.clipLengthSeconds * status.object.nominalFPS);
+  const size_t clipFrames = bufferSize;
+  // Covers a save that falls up to a second behind capture, plus the frames
+  // the preview and recorder hold on to; a deeper encode backlog borrows more
+  const size_t spareFrames = std::max<size_t>(2, status.object.nominalFPS);
+  std::unique_ptr<FrameHistory> frames;
+  std::unique_ptr<SegmentRecorder> recorder;
+  try
   {
-    cv::Mat frame;
-    cap.read(frame);
-    
-    if (frame.empty())
+    switch (parameters.recordingMode)
     {
-      spdlog::get("camera")->warn("ERROR! blank frame grabbed");
-      continue;
+    default:
+    case RecordingMode::Raw:
+      frames = std::make_unique<FrameRing>(status.object.resolution, CV_8UC3, bufferSize, spareFrames, parameters.hugePages);
+      log->info("Allocated {} frame buffer with {} spares ({} MB)",
+        bufferSize,
+        spareFrames,
+        double(size_t(status.object.resolution.area()) * 3 * (bufferSize + spareFrames)) / 1024.0 / 1024.0);
+      break;
+    case RecordingMode::Compressed:
+      frames = std::make_unique<CompressedFrameRing>(status.object.resolution, CV_8UC3, bufferSize, parameters.compressionQuality, parameters.hugePages);
+      log->info("Allocated {} frame compressed buffer", bufferSize);
+      break;
+    case RecordingMode::Segmented:
+      // The clip itself lives on disk; only keep enough frames around to
+      // pick a thumbnail from
+      bufferSize = std::max<size_t>(1, (parameters.triggerDelay + 1) * status.object.nominalFPS);
+      // Every frame queued for the recorder pins its slot as well
+      frames = std::make_unique<FrameRing>(status.object.resolution, CV_8UC3, bufferSize,
+        spareFrames + SegmentRecorder::GetQueueLimit(status.object.nominalFPS), parameters.hugePages);
+      recorder = std::make_unique<SegmentRecorder>(
+        GetDataPath() / "segments" / NAME,
+        status.object.resolution,
+        status.object.nominalFPS,
+        parameters.segmentSeconds,
+        parameters.clipLengthSeconds,
+        parameters.encoderProfile,
+        library.GetEncodeConcurrency());
+      log->info("Recording {}s segments; allocated {} frame thumbnail buffer", parameters.segmentSeconds, bufferSize);
+      break;
     }
+  }
+  catch (std::bad_alloc&)
+  {
+    log->critical("ERROR! Unable to allocate {} frame buffer", bufferSize);
+    return;
+  }
+
+  Pipeline pipeline(std::move(frames), std::move(recorder), clipFrames, bayerMode, status.object.resolution);
 
-    if (bayerMode)
+  // Buffers start out free; after this only the conversion stage returns them
+  for (size_t i = 0; i < pipeline.rawFrames.size(); ++i)
+    pipeline.recycled.TryPush(i);
+
+  std::thread conversion(&Camera::RunConversion, this, std::ref(pipeline));
+  std::thread previewer(&Camera::RunPreview, this, std::ref(pipeline));
+
+  // The grab loop only reads frames and hands them on; if downstream is
+  // backed up the frame is dropped rather than holding up the camera
+  std::optional<size_t> buffer;
+  while(abort.test_and_set())
+  {
+    if (!buffer)
     {
-      cv::Mat bayer = frame.reshape(0, status.object.resolution.height);
-      switch (bayerMode.value())
+      size_t free;
+      if (pipeline.recycled.TryPop(free))
+        buffer = free;
+      else
       {
-      default:
-      case BayerMode::GB:
-        cv::cvtColor(bayer, frame, cv::COLOR_BayerGB2BGR);
-        break;
-      case BayerMode::BG:
-        cv::cvtColor(bayer, frame, cv::COLOR_BayerBG2BGR);
-        break;
-      case BayerMode::RG:
-        cv::cvtColor(bayer, frame, cv::COLOR_BayerRG2BGR);
-        break;
-      case BayerMode::GR:
-        cv::cvtColor(bayer, frame, cv::COLOR_BayerGR2BGR);
-        break;
+        cap.grab();
+        continue;
       }
     }
-    
-    frames[frameIndex] = frame.clone();
-    frameIndex = (frameIndex + 1) % frames.size();
+
+    cv::Mat& raw = pipeline.rawFrames[buffer.value()];
+    cap.read(raw);
+    if (raw.empty())
+    {
+      log->warn("ERROR! blank frame grabbed");
+      continue;
+    }
+
+    if (pipeline.captured.TryPush(buffer.value()))
+      buffer.reset();
+  }
+
+  pipeline.running = false;
+  conversion.join();
+  previewer.join();
+}
+
+// Stages sleep on their queues; this only bounds how long they take to see
+// the pipeline stopping
+constexpr std::chrono::milliseconds STAGE_WAKE(100);
+
+void Camera::RunConversion(Pipeline& pipeline)
+{
+  FrameHistory& frames = *pipeline.frames;
+  FrameAnalyzer analyzer(pipeline.resolution, pipeline.bayerMode, status.object.nominalFPS, pipeline.clipFrames);
+  EncoderProfile encoderProfile;
+  auto configure = [&]()
+  {
+    analyzer.Configure([this](CameraProperty property) { return GetProperty(property); });
+    encoderProfile = magic_enum::enum_cast<EncoderProfile>(GetProperty(CameraProperty::EncoderProfile)).value_or(EncoderProfile::Fast);
+  };
+
+  // The analyzer is new with every run, so it always starts out configured;
+  // changes made while running still come through the flag
+  applySettings.test_and_set();
+  configure();
+
+  while (pipeline.running)
+  {
+    size_t buffer;
+    if (!pipeline.captured.WaitPop(buffer, STAGE_WAKE))
+      continue;
 
     // If something cleared this flag, set it again, but reset the trigger
     if (!applySettings.test_and_set())
     {
-      spdlog::get("camera")->info("VideoTrigger settings changed; state cleared");
-      trigger = std::make_unique<VideoTrigger>(
-        status.object.nominalFPS,
-        GetProperty(CameraProperty::EdgeDetectionSeconds),
-        GetProperty(CameraProperty::DebounceSeconds),
-        GetProperty(CameraProperty::TriggerDelay),
-        GetProperty(CameraProperty::TriggerThreshold));
+      log->info("VideoTrigger settings changed; state cleared");
+      configure();
     }
 
+    // Frames are measured, then demosaiced straight into the next ring slot
+    // or swapped into the ring whole, before the raw buffer (now holding a
+    // free slot's memory for colour sources) goes back to the grab loop
+    cv::Mat& raw = pipeline.rawFrames[buffer];
+    analyzer.Measure(raw);
+    bool committed = CommitFrame(raw, pipeline.bayerMode, pipeline.resolution, frames);
+    pipeline.recycled.TryPush(buffer);
+    
+    // Mismatched or dropped frames are logged by the history itself.  The
+    // trigger still sees them, so a strike is never missed just because its
+    // frame could not be kept
+    if (committed && pipeline.recorder)
+      pipeline.recorder->Push(frames.PinNewest());
+
     // Check if there was an event
-    if (trigger->ShouldCapture(frame))
+    if (analyzer.ShouldCapture())
     {
-      std::shared_ptr<std::vector<cv::Mat>> clip = std::make_shared<std::vector<cv::Mat>>();
-      clip->reserve(frames.size() + 1);
-      for (size_t i = 0; i < (frames.size() + 1); ++i)
-        clip->push_back(frames[(frameIndex + i) % frames.size()].clone());
-      library.SaveClip(clip, status.object.resolution, status.object.nominalFPS, trigger->GetSeekForThumbnail());
+      // Pins the buffered frames in place; the save job reads them directly
+      if (pipeline.recorder)
+        library.SaveSegments(NUMBER, pipeline.recorder->Cut(), frames.Snapshot(), analyzer.GetPeakSeekBack(), analyzer.GetTrace());
+      else
+        library.SaveClip(NUMBER, frames.Snapshot(), status.object.nominalFPS, encoderProfile, analyzer.GetPeakSeekBack(), analyzer.GetTrace());
     }
     
     // Update the FPS counter
     counter.Update();
+    pipeline.measuredFPS = counter.GetFPSAveraged();
+
+    // Preview is best effort; if that stage is behind this frame is skipped
+    if (committed)
+      pipeline.previews.TryPush(frames.PinNewest());
+  }
+}
 
-    // If no one is looking, let's update the preview
-    if (std::unique_lock lock(preview.mutex, std::try_to_lock); lock)
-      preview.object = frame.clone();
+void Camera::RunPreview(Pipeline& pipeline)
+{
+  std::shared_ptr<ClipFrames> frame;
+  cv::Mat scratch;
+  cv::Mat scaled;
+  auto nextPreview = std::chrono::steady_clock::now();
 
-    // We didn't acquire a r/o lock above, because the only writes are below
-    // The code below is not going to run async to the code above
+  while (pipeline.running)
+  {
+    if (!pipeline.previews.WaitPop(frame, STAGE_WAKE))
+      continue;
+
+    // The preview is encoded once here and shared by every request, at no
+    // more than PreviewRate frames a second
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextPreview)
+    {
+      double rate = std::max(0.1, GetProperty(CameraProperty::PreviewRate));
+      int width = GetProperty(CameraProperty::PreviewWidth);
+      nextPreview = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+
+      const cv::Mat& full = frame->Get(0, scratch);
+      if (width > 0 && width < full.cols)
+        cv::resize(full, scaled, cv::Size(width, std::max(1, full.rows * width / full.cols)), 0, 0, cv::INTER_AREA);
+      else
+        scaled = full;
+      auto jpeg = std::make_shared<std::vector<uchar>>();
+      cv::imencode(".jpg", scaled, *jpeg);
+      scaled.release();
+
+      std::unique_lock lock(preview.mutex);
+      preview.object.jpeg = std::move(jpeg);
+      ++preview.object.generation;
+    }
+    frame.reset();
+
+    // Only this stage writes the status once the pipeline is running
     if (std::unique_lock lock(status.mutex, std::try_to_lock); lock)
-      status.object.measuredFPS = counter.GetFPSAveraged();
+    {
+      status.object.measuredFPS = pipeline.measuredFPS;
+      status.object.captureQueue = { pipeline.captured.Depth(), pipeline.captured.Capacity(), pipeline.captured.Overflows() };
+      status.object.previewQueue = { pipeline.previews.Depth(), pipeline.previews.Capacity(), pipeline.previews.Overflows() };
+    }
   }
 }
\ No newline at end of file
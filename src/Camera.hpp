@@ -19,8 +19,9 @@
 #define CAMERA_HPP
 
 #include "VideoLibrary.hpp"
-#include "VideoTrigger.hpp"
 #include "FPSCounter.hpp"
+#include "FrameHistory.hpp"
+#include "EncoderProfile.hpp"
 
 #include <opencv2/videoio.hpp>
 #include <atomic>
@@ -30,6 +31,7 @@
 #include <mutex>
 #include <map>
 #include <magic_enum.hpp>
+#include <spdlog/logger.h>
 
 enum class CameraProperty
 {
@@ -40,7 +42,21 @@ enum class CameraProperty
   ClipLengthSeconds,
   BayerMode,
   Width,
-  Height
+  Height,
+  HugePages,
+  RecordingMode,
+  CompressionQuality,
+  SegmentSeconds,
+  AnalysisDecimation,
+  TriggerMode,
+  ZScoreThreshold,
+  TileColumns,
+  TileRows,
+  DetectorMode,
+  DifferenceScale,
+  EncoderProfile,
+  PreviewRate,
+  PreviewWidth
 };
 constexpr auto CameraPropertyEntries = magic_enum::enum_entries<CameraProperty>();
 
@@ -52,6 +68,22 @@ enum class BayerMode
   GR = 4
 };
 
+enum class DetectorMode
+{
+  // Mean brightness against its rolling baseline
+  Brightness = 0,
+  // Change since the previous frame; ignores slow exposure drift and is
+  // less thrown by steady motion in a bright scene
+  FrameDifference = 1
+};
+
+enum class RecordingMode
+{
+  Raw = 0,
+  Compressed = 1,
+  Segmented = 2
+};
+
 template<typename T>
 struct SharedLockable
 {
@@ -66,20 +98,59 @@ struct UniqueLockable
   std::mutex mutex;
 };
 
+struct CaptureParameters
+{
+  double clipLengthSeconds;
+  std::optional<BayerMode> bayerMode;
+  std::optional<cv::Size> requestedDimensions;
+  bool hugePages;
+  RecordingMode recordingMode;
+  int compressionQuality;
+  double segmentSeconds;
+  double triggerDelay;
+  EncoderProfile encoderProfile;
+};
+
+struct QueueStatus
+{
+  size_t depth = 0;
+  size_t capacity = 0;
+  size_t overflows = 0;
+};
+
+// A JPEG of the live view.  The buffer is never modified once published,
+// so it can be handed to any number of responses as is; generation goes up
+// by one for every new image.
+struct PreviewImage
+{
+  uint64_t generation = 0;
+  std::shared_ptr<const std::vector<uchar>> jpeg;
+};
+
 struct CameraStatus
 {
   cv::Size resolution;
   double nominalFPS;
   double measuredFPS;
+  QueueStatus captureQueue;
+  QueueStatus previewQueue;
 };
 
 class Camera
 {
 public:
-  Camera(VideoLibrary& videoLibrary);
+  // source is a device index ("0") or anything else VideoCapture can open
+  // (a file, URL or pipeline); name keys the settings and segment storage
+  // Cameras are named by their number, which also goes into their clip IDs
+  Camera(VideoLibrary& videoLibrary, uint16_t number, const std::string& source);
   virtual ~Camera();
 
-  std::vector<uchar> GetPreview();
+  const std::string& GetName() const;
+  const std::string& GetSource() const;
+  // What a camera starts with before its settings file is read
+  static std::map<CameraProperty, double> GetDefaultProperties();
+
+  PreviewImage GetPreview();
   double GetProperty(CameraProperty property) const;
   void SetProperty(CameraProperty property, double value);
   void ApplyPropertyChange();
@@ -88,15 +159,25 @@ public:
   void Stop();
   bool IsRunning();
 private:
-  void Run(double clipLengthSeconds = 30, std::optional<BayerMode> bayerMode = std::nullopt, std::optional<cv::Size> requestedDimensions = std::nullopt);
+  struct Pipeline;
+
+  void Run(CaptureParameters parameters);
+  void RunConversion(Pipeline& pipeline);
+  void RunPreview(Pipeline& pipeline);
+  std::filesystem::path GetSettingsPath() const;
   void LoadSettings();
   void SaveSettings();
 
-  std::unique_ptr<VideoTrigger> trigger;
+  const uint16_t NUMBER;
+  const std::string NAME;
+  const std::string SOURCE;
+  std::shared_ptr<spdlog::logger> log;
   VideoLibrary& library;
   FPSCounter counter;
-  std::map<CameraProperty, double> properties;
-  SharedLockable<cv::Mat> preview;
+  // Written by HTTP handlers, read by the capture threads
+  mutable SharedLockable<std::map<CameraProperty, double>> properties;
+  std::mutex settingsFileMutex;
+  SharedLockable<PreviewImage> preview;
   SharedLockable<CameraStatus> status;
   std::atomic_flag abort;
   std::atomic_flag applySettings;
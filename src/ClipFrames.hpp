@@ -0,0 +1,57 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLIPFRAMES_HPP
+#define CLIPFRAMES_HPP
+
+#include <opencv2/core/mat.hpp>
+#include <cstdint>
+#include <optional>
+
+// Where a clip sits in the run of frames it was cut from.  stream names the
+// history (unique for the life of the process) and first counts the frames
+// committed to it before the clip's first frame.
+struct ClipPosition
+{
+  uint64_t stream;
+  uint64_t first;
+};
+
+// Read-only view over the frames making up a clip, handed from the capture
+// thread to a save job without copying pixel data
+class ClipFrames
+{
+public:
+  virtual ~ClipFrames() = default;
+
+  virtual size_t Size() const = 0;
+  virtual cv::Size Dimensions() const = 0;
+  // Memory the clip is still holding on to; released frames don't count
+  virtual size_t Bytes() const = 0;
+
+  // Returns the frame at index; implementations either hand back the frame
+  // in place or materialize it into scratch
+  virtual const cv::Mat& Get(size_t index, cv::Mat& scratch) const = 0;
+
+  // The consumer is done with the frame at index and will not ask again
+  virtual void Release(size_t index) { (void)index; }
+
+  // Clips cut from the same history can be lined up against each other
+  virtual std::optional<ClipPosition> Position() const { return std::nullopt; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ClipIndex.hpp"
+
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <chrono>
+#include <magic_enum.hpp>
+#include <sstream>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// After a header line, manifest lines are "+<id> <bytes> <protected>" for a
+// clip (repeated when it changes) and "-<id>" for a clip since deleted; the
+// file is compacted to the surviving additions on startup
+constexpr std::string_view MANIFEST_HEADER = "stormwatch-clips 3";
+constexpr char ADDED = '+';
+constexpr char REMOVED = '-';
+
+bool operator<(const ClipRecord& a, const ClipRecord& b)
+{
+  return a.id < b.id;
+}
+
+bool operator<(const ClipRecord& a, const VideoID& b)
+{
+  return a.id < b;
+}
+
+bool operator<(const VideoID& a, const ClipRecord& b)
+{
+  return a < b.id;
+}
+
+ClipIndex::ClipIndex(fs::path libraryPath)
+  : LIBRARY_PATH(libraryPath),
+    MANIFEST_PATH(libraryPath / "clips.manifest"),
+    EPOCH(std::chrono::system_clock::now().time_since_epoch().count()),
+    totalBytes(0),
+    generation(0)
+{
+  // The index is the first thing to look at the library, so a fresh install
+  // gets its directory here
+  fs::create_directories(LIBRARY_PATH);
+
+  auto start = std::chrono::steady_clock::now();
+  if (!LoadManifest())
+    Rebuild();
+  for (const auto& clip : entries)
+    totalBytes += clip.bytes;
+  WriteManifest();
+
+  spdlog::get("library")->info("Indexed {} clips ({} MB) in {} ms", entries.size(), totalBytes / 1024 / 1024,
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ClipIndex::Add(const ClipRecord& clip)
+{
+  std::unique_lock lock(mutex);
+  // New clips are nearly always the newest, so this is usually an append
+  auto position = std::upper_bound(entries.begin(), entries.end(), clip);
+  if (position != entries.begin() && std::prev(position)->id == clip.id)
+    return;
+  entries.insert(position, clip);
+  totalBytes += clip.bytes;
+  ++generation;
+  Journal(clip);
+}
+
+void ClipIndex::Remove(const VideoID& clip)
+{
+  std::unique_lock lock(mutex);
+  auto [first, last] = std::equal_range(entries.begin(), entries.end(), clip);
+  if (first == last)
+    return;
+  for (auto i = first; i != last; ++i)
+    totalBytes -= i->bytes;
+  entries.erase(first, last);
+  ++generation;
+  journal << REMOVED << clip.GetID() << std::endl;
+}
+
+bool ClipIndex::SetProtected(const VideoID& clip, bool isProtected)
+{
+  std::unique_lock lock(mutex);
+  auto entry = std::lower_bound(entries.begin(), entries.end(), clip);
+  if (entry == entries.end() || entry->id != clip)
+    return false;
+  if (entry->isProtected != isProtected)
+  {
+    entry->isProtected = isProtected;
+    ++generation;
+    Journal(*entry);
+  }
+  return true;
+}
+
+ClipPage ClipIndex::Query(const ClipQuery& query) const
+{
+  std::shared_lock lock(mutex);
+  auto before = [](const ClipRecord& clip, int64_t time) { return clip.id.GetTime() < time; };
+  auto first = query.from ?
+    std::lower_bound(entries.begin(), entries.end(), query.from.value(), before) :
+    entries.begin();
+  auto last = query.to ?
+    std::lower_bound(first, entries.end(), query.to.value(), before) :
+    entries.end();
+
+  ClipPage page;
+  page.total = std::distance(first, last);
+  size_t count = std::min(query.limit, page.total - std::min(query.offset, page.total));
+  page.clips.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    page.clips.push_back(query.newestFirst ?
+      *(last - 1 - (query.offset + i)) :
+      *(first + query.offset + i));
+  return page;
+}
+
+ClipUsage ClipIndex::GetUsage() const
+{
+  std::shared_lock lock(mutex);
+  return { entries.size(), totalBytes };
+}
+
+std::optional<ClipRecord> ClipIndex::GetOldestUnprotected() const
+{
+  std::shared_lock lock(mutex);
+  auto oldest = std::find_if(entries.begin(), entries.end(), [](const ClipRecord& clip) { return !clip.isProtected; });
+  if (oldest == entries.end())
+    return std::nullopt;
+  return *oldest;
+}
+
+std::string ClipIndex::GetVersion() const
+{
+  std::shared_lock lock(mutex);
+  return fmt::format("{:x}-{}", EPOCH, generation);
+}
+
+fs::path ClipIndex::GetProtectionMarker(const fs::path& libraryPath, const VideoID& clip)
+{
+  return libraryPath / (clip.GetID() + ".keep");
+}
+
+fs::path ClipIndex::GetVideoPath(const fs::path& libraryPath, const VideoID& clip)
+{
+  return libraryPath / (clip.GetID() + ".webm");
+}
+
+fs::path ClipIndex::GetStillPath(const fs::path& libraryPath, const VideoID& clip, StillSize size)
+{
+  switch (size)
+  {
+  case StillSize::Medium:
+    return libraryPath / (clip.GetID() + ".medium.jpeg");
+  case StillSize::Full:
+    return libraryPath / (clip.GetID() + ".full.jpeg");
+  default:
+  case StillSize::Thumbnail:
+    return libraryPath / (clip.GetID() + ".jpeg");
+  }
+}
+
+fs::path ClipIndex::GetTracePath(const fs::path& libraryPath, const VideoID& clip)
+{
+  return libraryPath / (clip.GetID() + ".trace");
+}
+
+std::vector<fs::path> ClipIndex::GetClipFiles(const fs::path& libraryPath, const VideoID& clip)
+{
+  std::vector<fs::path> files{ GetVideoPath(libraryPath, clip) };
+  for (auto size : magic_enum::enum_values<StillSize>())
+    files.push_back(GetStillPath(libraryPath, clip, size));
+  files.push_back(GetTracePath(libraryPath, clip));
+  return files;
+}
+
+void ClipIndex::Journal(const ClipRecord& clip)
+{
+  journal << ADDED << clip.id.GetID() << ' ' << clip.bytes << ' ' << clip.isProtected << std::endl;
+}
+
+bool ClipIndex::LoadManifest()
+{
+  std::ifstream manifest(MANIFEST_PATH, std::ios_base::binary);
+  if (!manifest)
+    return false;
+
+  std::string line;
+  if (!std::getline(manifest, line) || line != MANIFEST_HEADER)
+  {
+    spdlog::get("library")->warn("Clip manifest {} is from another version, rebuilding", MANIFEST_PATH.string());
+    return false;
+  }
+
+  // Replayed in order, so the last word on each clip wins
+  std::unordered_map<std::string, ClipRecord> clips;
+  while (std::getline(manifest, line))
+  {
+    std::istringstream fields(line);
+    char change = 0;
+    std::string id;
+    fields >> change >> id;
+    auto clip = VideoID::Parse(id);
+    if (clip && change == ADDED)
+    {
+      ClipRecord record{ clip.value() };
+      if (fields >> record.bytes >> record.isProtected)
+      {
+        clips.insert_or_assign(id, std::move(record));
+        continue;
+      }
+    }
+    else if (clip && change == REMOVED)
+    {
+      clips.erase(id);
+      continue;
+    }
+
+    spdlog::get("library")->warn("Clip manifest {} is damaged, rebuilding", MANIFEST_PATH.string());
+    return false;
+  }
+
+  entries.clear();
+  entries.reserve(clips.size());
+  for (auto& clip : clips)
+    entries.push_back(std::move(clip.second));
+  std::sort(entries.begin(), entries.end());
+  return true;
+}
+
+void ClipIndex::Rebuild()
+{
+  spdlog::get("library")->info("No clip manifest, indexing {}", LIBRARY_PATH.string());
+
+  // Listing is one pass over the directory; decoding the names and sizing
+  // the files is the slow part, and that splits across every core
+  std::vector<std::string> names;
+  // Only thumbnails; the larger stills have a second extension
+  for (auto& file : fs::directory_iterator(LIBRARY_PATH))
+    if (file.path().extension() == ".jpeg" && !file.path().stem().has_extension())
+      names.push_back(file.path().stem().string());
+
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk = (names.size() + threads - 1) / threads;
+  std::vector<std::vector<ClipRecord>> parts(threads);
+  {
+    boost::asio::thread_pool pool(threads);
+    for (size_t t = 0; t < threads; ++t)
+      boost::asio::post(pool, [&, t]
+      {
+        for (size_t i = t * chunk; i < std::min(names.size(), (t + 1) * chunk); ++i)
+        {
+          auto clip = VideoID::Parse(names[i]);
+          if (!clip)
+          {
+            spdlog::get("library")->warn("Skipping {}, not a clip", names[i]);
+            continue;
+          }
+
+          ClipRecord record{ clip.value() };
+          std::error_code error;
+          for (const auto& path : GetClipFiles(LIBRARY_PATH, record.id))
+          {
+            auto size = fs::file_size(path, error);
+            if (!error)
+              record.bytes += size;
+          }
+          record.isProtected = fs::exists(GetProtectionMarker(LIBRARY_PATH, record.id), error);
+          parts[t].push_back(std::move(record));
+        }
+      });
+    pool.join();
+  }
+
+  entries.clear();
+  for (auto& part : parts)
+    entries.insert(entries.end(), part.begin(), part.end());
+  std::sort(entries.begin(), entries.end());
+}
+
+void ClipIndex::WriteManifest()
+{
+  // Written aside and renamed over, so a crash leaves either manifest whole
+  auto compacted = fs::path(MANIFEST_PATH).replace_extension("manifest.new");
+  {
+    std::ofstream manifest(compacted, std::ios_base::binary | std::ios_base::trunc);
+    manifest << MANIFEST_HEADER << '\n';
+    for (const auto& clip : entries)
+      manifest << ADDED << clip.id.GetID() << ' ' << clip.bytes << ' ' << clip.isProtected << '\n';
+    if (!manifest.flush())
+    {
+      // Better to index from scratch next time than trust the old one
+      std::error_code error;
+      fs::remove(MANIFEST_PATH, error);
+      spdlog::get("library")->error("Could not write clip manifest {}", compacted.string());
+      return;
+    }
+  }
+  fs::rename(compacted, MANIFEST_PATH);
+  journal.open(MANIFEST_PATH, std::ios_base::binary | std::ios_base::app);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLIPINDEX_HPP
+#define CLIPINDEX_HPP
+
+#include "VideoID.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Sizes the peak frame of each clip is kept at
+enum class StillSize
+{
+  // For clip lists; <id>.jpeg
+  Thumbnail = 0,
+  // For players and larger previews; <id>.medium.jpeg
+  Medium = 1,
+  // The frame as captured; <id>.full.jpeg
+  Full = 2
+};
+
+struct ClipRecord
+{
+  VideoID id;
+  // Video, stills and trace together
+  uint64_t bytes = 0;
+  // Kept by the retention manager no matter how old it gets
+  bool isProtected = false;
+};
+
+struct ClipQuery
+{
+  // Nanoseconds since the epoch (as VideoID::GetTime); from is inclusive,
+  // to exclusive
+  std::optional<int64_t> from;
+  std::optional<int64_t> to;
+  size_t offset = 0;
+  size_t limit = 100;
+  bool newestFirst = true;
+};
+
+struct ClipPage
+{
+  // Clips in the requested range, before offset and limit
+  size_t total = 0;
+  std::vector<ClipRecord> clips;
+};
+
+struct ClipUsage
+{
+  size_t clips = 0;
+  uint64_t bytes = 0;
+};
+
+// Every clip in the library, sorted by time, with a running total of the
+// space they take.  Changes are appended to a manifest next to the clips so
+// startup doesn't need to look at every file; without one the index is
+// rebuilt from the directory.
+class ClipIndex
+{
+public:
+  explicit ClipIndex(std::filesystem::path libraryPath);
+
+  void Add(const ClipRecord& clip);
+  void Remove(const VideoID& clip);
+  // False if there's no such clip
+  bool SetProtected(const VideoID& clip, bool isProtected);
+  ClipPage Query(const ClipQuery& query) const;
+  ClipUsage GetUsage() const;
+  std::optional<ClipRecord> GetOldestUnprotected() const;
+  // Changes whenever the set of clips does, including across restarts
+  std::string GetVersion() const;
+
+  // Marker file that records a clip's protection on disk, so it survives
+  // the manifest being lost
+  static std::filesystem::path GetProtectionMarker(const std::filesystem::path& libraryPath, const VideoID& clip);
+  // Where a clip's files live.  The thumbnail is written last, so once it
+  // is there the clip is complete
+  static std::filesystem::path GetVideoPath(const std::filesystem::path& libraryPath, const VideoID& clip);
+  static std::filesystem::path GetStillPath(const std::filesystem::path& libraryPath, const VideoID& clip, StillSize size);
+  static std::filesystem::path GetTracePath(const std::filesystem::path& libraryPath, const VideoID& clip);
+  // The video, every still and the trace; what a clip's size is counted over
+  static std::vector<std::filesystem::path> GetClipFiles(const std::filesystem::path& libraryPath, const VideoID& clip);
+private:
+  bool LoadManifest();
+  void Rebuild();
+  void WriteManifest();
+  void Journal(const ClipRecord& clip);
+
+  const std::filesystem::path LIBRARY_PATH;
+  const std::filesystem::path MANIFEST_PATH;
+  const int64_t EPOCH;
+
+  mutable std::shared_mutex mutex;
+  std::vector<ClipRecord> entries;
+  uint64_t totalBytes;
+  uint64_t generation;
+  std::ofstream journal;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,102 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ClipStills.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <spdlog/spdlog.h>
+
+// Box each still is fitted inside; empty to keep the captured size
+cv::Size GetStillBounds(StillSize size)
+{
+  switch (size)
+  {
+  case StillSize::Thumbnail:
+    return cv::Size(160, 120);
+  case StillSize::Medium:
+    return cv::Size(640, 480);
+  default:
+  case StillSize::Full:
+    return cv::Size();
+  }
+}
+
+// Never scales up; a frame already inside the box keeps its size
+cv::Size FitInside(cv::Size frame, cv::Size bounds)
+{
+  if (bounds.empty())
+    return frame;
+  double scale = std::min({ 1.0, double(bounds.width) / frame.width, double(bounds.height) / frame.height });
+  return cv::Size(
+    std::max(1, int(std::lround(frame.width * scale))),
+    std::max(1, int(std::lround(frame.height * scale))));
+}
+
+StillImages MakeStills(const ClipFrames& frames, size_t peakSeekBack)
+{
+  StillImages stills;
+  if (frames.Size() == 0)
+    return stills;
+
+  cv::Mat scratch;
+  size_t peakIndex = frames.Size() > peakSeekBack ? frames.Size() - peakSeekBack : 0;
+  const cv::Mat* peak = &frames.Get(peakIndex, scratch);
+  if (peak->empty())
+    peak = &frames.Get(frames.Size() - 1, scratch);
+  if (peak->empty())
+    return stills;
+
+  // Each size is scaled from the one above it rather than the full frame,
+  // which is cheaper and, with area averaging, looks the same
+  const cv::Mat* source = peak;
+  for (auto size : { StillSize::Full, StillSize::Medium, StillSize::Thumbnail })
+  {
+    cv::Mat& still = stills[magic_enum::enum_integer(size)];
+    cv::Size dimensions = FitInside(peak->size(), GetStillBounds(size));
+    if (dimensions == source->size())
+      source->copyTo(still);
+    else
+      cv::resize(*source, still, dimensions, 0, 0, cv::INTER_AREA);
+    source = &still;
+  }
+  return stills;
+}
+
+bool WriteStills(const StillImages& stills, const StillPaths& paths)
+{
+  for (auto size : { StillSize::Full, StillSize::Medium, StillSize::Thumbnail })
+  {
+    auto index = magic_enum::enum_integer(size);
+    if (stills[index].empty() || !cv::imwrite(paths[index].string(), stills[index]))
+    {
+      spdlog::get("library")->error("Unable to write still {}", paths[index].string());
+      return false;
+    }
+  }
+  return true;
+}
+
+void DiscardClip(const std::filesystem::path& videoPath, const StillPaths& paths)
+{
+  std::error_code error;
+  std::filesystem::remove(videoPath, error);
+  for (const auto& path : paths)
+    std::filesystem::remove(path, error);
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLIPSTILLS_HPP
+#define CLIPSTILLS_HPP
+
+#include "ClipFrames.hpp"
+#include "ClipIndex.hpp"
+
+#include <array>
+#include <filesystem>
+#include <magic_enum.hpp>
+#include <opencv2/core/mat.hpp>
+
+using StillImages = std::array<cv::Mat, magic_enum::enum_count<StillSize>()>;
+using StillPaths = std::array<std::filesystem::path, magic_enum::enum_count<StillSize>()>;
+
+// Copies the frame peakSeekBack frames from the end of the clip (1 being
+// the last) at every still size, keeping its aspect ratio.  Call before the
+// frames are released; the stills don't refer back to them
+StillImages MakeStills(const ClipFrames& frames, size_t peakSeekBack);
+
+// Largest first, so the thumbnail turning up means every still is there
+bool WriteStills(const StillImages& stills, const StillPaths& paths);
+
+// Deletes what a failed save may have left of a clip; nothing would ever
+// index, and so ever evict, a clip without its thumbnail
+void DiscardClip(const std::filesystem::path& videoPath, const StillPaths& paths);
+
+#endif
\ No newline at end of file
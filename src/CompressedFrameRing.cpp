@@ -0,0 +1,208 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CompressedFrameRing.hpp"
+
+#include <boost/asio/post.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <thread>
+
+class CompressedClip : public ClipFrames
+{
+public:
+  CompressedClip(std::vector<CompressedFrameRing::EncodedFrame> frames, cv::Size dimensions, ClipPosition position)
+    : frames(std::move(frames)),
+      dimensions(dimensions),
+      position(position)
+  {
+  }
+
+  size_t Size() const override
+  {
+    return frames.size();
+  }
+
+  cv::Size Dimensions() const override
+  {
+    return dimensions;
+  }
+
+  // Never waits on a compression; frames still in flight are counted at the
+  // average size of the ones already done
+  size_t Bytes() const override
+  {
+    size_t bytes = 0;
+    size_t done = 0;
+    size_t pending = 0;
+    for (const auto& frame : frames)
+    {
+      if (!frame.valid())
+        continue;
+      if (frame.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      {
+        bytes += frame.get().size();
+        ++done;
+      }
+      else
+        ++pending;
+    }
+    return done == 0 ? bytes : bytes + bytes / done * pending;
+  }
+
+  const cv::Mat& Get(size_t index, cv::Mat& scratch) const override
+  {
+    cv::imdecode(frames[index].get(), cv::IMREAD_COLOR, &scratch);
+    return scratch;
+  }
+
+  void Release(size_t index) override
+  {
+    frames[index] = CompressedFrameRing::EncodedFrame();
+  }
+
+  std::optional<ClipPosition> Position() const override
+  {
+    return position;
+  }
+private:
+  std::vector<CompressedFrameRing::EncodedFrame> frames;
+  cv::Size dimensions;
+  ClipPosition position;
+};
+
+unsigned EncoderThreads()
+{
+  return std::max(1u, std::thread::hardware_concurrency() / 2);
+}
+
+CompressedFrameRing::CompressedFrameRing(cv::Size dimensions, int type, size_t capacity, int quality, bool hugePages)
+  : dimensions(dimensions),
+    encodeParameters({ cv::IMWRITE_JPEG_QUALITY, quality }),
+    maxInFlight(EncoderThreads() * 2),
+    pool(EncoderThreads()),
+    // One slot more than can be in flight, so Next() never lands on a frame
+    // that is still being compressed; the spares cover the newest frame
+    // pinned by the preview
+    staging(dimensions, type, maxInFlight + 1, 2, hugePages),
+    frames(capacity),
+    head(0),
+    count(0),
+    stream(NewStreamID()),
+    committed(0)
+{
+}
+
+CompressedFrameRing::~CompressedFrameRing()
+{
+  // Let queued compressions finish; snapshots may still be waiting on them
+  pool.join();
+}
+
+cv::Mat& CompressedFrameRing::Next()
+{
+  while (inFlight.size() >= maxInFlight)
+  {
+    if (inFlight.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      spdlog::get("camera")->warn("Frame compression is falling behind capture");
+      inFlight.front().wait();
+    }
+    inFlight.pop_front();
+  }
+  return staging.Next();
+}
+
+bool CompressedFrameRing::Commit()
+{
+  if (!staging.Commit())
+    return false;
+  Compress();
+  return true;
+}
+
+bool CompressedFrameRing::Adopt(cv::Mat& frame)
+{
+  // Waits for a staging slot to come free, as for any other frame
+  Next();
+  if (!staging.Adopt(frame))
+    return false;
+  Compress();
+  return true;
+}
+
+// Queues the newest staged frame for compression and publishes its future
+void CompressedFrameRing::Compress()
+{
+  auto promise = std::make_shared<std::promise<std::vector<uchar>>>();
+  EncodedFrame encoded = promise->get_future().share();
+  boost::asio::post(pool, [promise, raw = staging.Snapshot(1), this]() mutable
+  {
+    try
+    {
+      std::vector<uchar> buffer;
+      cv::Mat scratch;
+      cv::imencode(".jpg", raw->Get(0, scratch), buffer, encodeParameters);
+      // Unpin the staging slot before anyone waiting on the frame wakes up
+      raw.reset();
+      promise->set_value(std::move(buffer));
+    }
+    catch (...)
+    {
+      raw.reset();
+      promise->set_exception(std::current_exception());
+    }
+  });
+
+  inFlight.push_back(encoded);
+  frames[head] = encoded;
+  head = (head + 1) % frames.size();
+  if (count < frames.size())
+    ++count;
+  ++committed;
+}
+
+const cv::Mat& CompressedFrameRing::Newest() const
+{
+  return staging.Newest();
+}
+
+std::shared_ptr<ClipFrames> CompressedFrameRing::Snapshot(size_t newest) const
+{
+  newest = std::min(newest, count);
+  std::vector<EncodedFrame> clip;
+  clip.reserve(newest);
+  for (size_t i = 0; i < newest; ++i)
+    clip.push_back(frames[(head + frames.size() - newest + i) % frames.size()]);
+  return std::make_shared<CompressedClip>(std::move(clip), dimensions, ClipPosition{ stream, committed - newest });
+}
+
+std::shared_ptr<ClipFrames> CompressedFrameRing::PinNewest() const
+{
+  return staging.Snapshot(1);
+}
+
+size_t CompressedFrameRing::Size() const
+{
+  return count;
+}
+
+size_t CompressedFrameRing::Capacity() const
+{
+  return frames.size();
+}
\ No newline at end of file
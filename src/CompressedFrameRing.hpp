@@ -0,0 +1,65 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSEDFRAMERING_HPP
+#define COMPRESSEDFRAMERING_HPP
+
+#include "FrameRing.hpp"
+
+#include <boost/asio/thread_pool.hpp>
+#include <deque>
+#include <future>
+#include <vector>
+
+// Frame history that keeps every frame JPEG compressed in memory.  Frames
+// are written into a small raw staging ring and compressed on a worker pool;
+// snapshots share the compressed buffers and are decoded on demand by the
+// save job.
+class CompressedFrameRing : public FrameHistory
+{
+public:
+  using EncodedFrame = std::shared_future<std::vector<uchar>>;
+
+  CompressedFrameRing(cv::Size dimensions, int type, size_t capacity, int quality = 90, bool hugePages = false);
+  virtual ~CompressedFrameRing();
+
+  cv::Mat& Next() override;
+  bool Commit() override;
+  bool Adopt(cv::Mat& frame) override;
+  const cv::Mat& Newest() const override;
+  std::shared_ptr<ClipFrames> Snapshot(size_t newest) const override;
+  using FrameHistory::Snapshot;
+  std::shared_ptr<ClipFrames> PinNewest() const override;
+  size_t Size() const override;
+  size_t Capacity() const override;
+private:
+  void Compress();
+
+  const cv::Size dimensions;
+  const std::vector<int> encodeParameters;
+  const size_t maxInFlight;
+  boost::asio::thread_pool pool;
+  FrameRing staging;
+  std::vector<EncodedFrame> frames;
+  std::deque<EncodedFrame> inFlight;
+  size_t head;
+  size_t count;
+  const uint64_t stream;
+  uint64_t committed;
+};
+
+#endif
\ No newline at end of file
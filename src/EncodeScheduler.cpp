@@ -0,0 +1,395 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "EncodeScheduler.hpp"
+
+#include <boost/asio/post.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <magic_enum.hpp>
+
+namespace fs = std::filesystem;
+
+// An older clip cut short where a newer, overlapping clip from the same
+// history begins, followed by the whole of the newer clip.  The newer clip
+// ends the merged one, so a peak counted back from its end still lands on
+// the same frame.
+class MergedClip : public ClipFrames
+{
+public:
+  MergedClip(std::shared_ptr<ClipFrames> head, size_t headFrames, std::shared_ptr<ClipFrames> tail)
+    : head(head),
+      headFrames(headFrames),
+      tail(tail)
+  {
+    // The rest of the older clip is covered by the newer one
+    for (size_t i = headFrames; i < head->Size(); ++i)
+      head->Release(i);
+  }
+
+  size_t Size() const override
+  {
+    return headFrames + tail->Size();
+  }
+
+  cv::Size Dimensions() const override
+  {
+    return tail->Dimensions();
+  }
+
+  size_t Bytes() const override
+  {
+    return head->Bytes() + tail->Bytes();
+  }
+
+  const cv::Mat& Get(size_t index, cv::Mat& scratch) const override
+  {
+    return index < headFrames ? head->Get(index, scratch) : tail->Get(index - headFrames, scratch);
+  }
+
+  void Release(size_t index) override
+  {
+    if (index < headFrames)
+      head->Release(index);
+    else
+      tail->Release(index - headFrames);
+  }
+
+  std::optional<ClipPosition> Position() const override
+  {
+    return head->Position();
+  }
+private:
+  std::shared_ptr<ClipFrames> head;
+  size_t headFrames;
+  std::shared_ptr<ClipFrames> tail;
+};
+
+// Frames written back to back, uncompressed, to a scratch file; read back
+// one at a time by the encoder.  The file goes with the clip.
+class SpilledClip : public ClipFrames
+{
+public:
+  SpilledClip(fs::path path, size_t size, cv::Size dimensions, int type, std::optional<ClipPosition> position)
+    : path(path),
+      file(path, std::ios_base::binary),
+      size(size),
+      dimensions(dimensions),
+      type(type),
+      frameBytes(size_t(dimensions.area()) * CV_ELEM_SIZE(type)),
+      position(position)
+  {
+  }
+
+  ~SpilledClip()
+  {
+    file.close();
+    std::error_code error;
+    fs::remove(path, error);
+  }
+
+  size_t Size() const override
+  {
+    return size;
+  }
+
+  cv::Size Dimensions() const override
+  {
+    return dimensions;
+  }
+
+  size_t Bytes() const override
+  {
+    return 0;
+  }
+
+  const cv::Mat& Get(size_t index, cv::Mat& scratch) const override
+  {
+    scratch.create(dimensions, type);
+    file.seekg(std::streamoff(index * frameBytes));
+    file.read(reinterpret_cast<char*>(scratch.data), std::streamsize(frameBytes));
+    return scratch;
+  }
+
+  std::optional<ClipPosition> Position() const override
+  {
+    return position;
+  }
+private:
+  fs::path path;
+  mutable std::ifstream file;
+  size_t size;
+  cv::Size dimensions;
+  int type;
+  size_t frameBytes;
+  std::optional<ClipPosition> position;
+};
+
+EncodeScheduler::EncodeScheduler(EncodeBudget budget, fs::path spillPath)
+  : BUDGET(budget),
+    SPILL_PATH(spillPath),
+    spillingBytes(0),
+    spillCount(0),
+    spillPool(1),
+    pool(std::max<size_t>(1, budget.threads))
+{
+  // Anything left over is from a previous run and has no job to go with it
+  if (fs::exists(SPILL_PATH))
+    fs::remove_all(SPILL_PATH);
+  if (BUDGET.policy == OverflowPolicy::Spill)
+    fs::create_directories(SPILL_PATH);
+
+  spdlog::get("library")->info("Encoding on {} threads; queue limited to {} clips and {} MB ({} when full)",
+    std::max<size_t>(1, BUDGET.threads),
+    BUDGET.maxQueued,
+    BUDGET.maxBytes / 1024 / 1024,
+    magic_enum::enum_name(BUDGET.policy));
+}
+
+EncodeScheduler::~EncodeScheduler()
+{
+  // Spills re-queue their jobs, so they have to finish first
+  spillPool.join();
+  pool.join();
+}
+
+void EncodeScheduler::Submit(const std::string& name, std::shared_ptr<ClipFrames> frames, Encoder encode, bool mergeable)
+{
+  auto job = std::make_shared<Job>();
+  job->name = name;
+  job->bytes = frames ? frames->Bytes() : 0;
+  job->frames = std::move(frames);
+  job->encode = std::move(encode);
+  job->mergeable = mergeable;
+  job->spilling = false;
+  job->onDisk = false;
+
+  {
+    std::unique_lock lock(mutex);
+    pending.push_back(job);
+    status.bytesInFlight += job->bytes;
+    Enforce();
+    status.queued = pending.size();
+  }
+  boost::asio::post(pool, [this]() { RunPending(); });
+}
+
+EncodeStatus EncodeScheduler::GetStatus()
+{
+  std::unique_lock lock(mutex);
+  return status;
+}
+
+size_t EncodeScheduler::GetConcurrency()
+{
+  std::unique_lock lock(mutex);
+  return std::max<size_t>(1, status.running);
+}
+
+bool EncodeScheduler::OverBudget() const
+{
+  // Jobs on their way to disk (or already there) no longer count
+  size_t inMemory = 0;
+  for (const auto& job : pending)
+    if (!job->onDisk && !job->spilling)
+      ++inMemory;
+  return inMemory > BUDGET.maxQueued || status.bytesInFlight - spillingBytes > BUDGET.maxBytes;
+}
+
+void EncodeScheduler::Enforce()
+{
+  while (OverBudget())
+  {
+    switch (BUDGET.policy)
+    {
+    case OverflowPolicy::Spill:
+      if (!SpillNewest())
+        return;
+      break;
+    case OverflowPolicy::Merge:
+      if (MergeNewest())
+        break;
+      [[fallthrough]];
+    default:
+    case OverflowPolicy::DropOldest:
+      if (!DropOldest())
+      {
+        // Only the clip just submitted is left; what is over budget is
+        // already encoding, and will be given back soon enough
+        spdlog::get("library")->warn("Encode backlog over budget with nothing left to drop");
+        return;
+      }
+      break;
+    }
+  }
+}
+
+bool EncodeScheduler::MergeNewest()
+{
+  auto& newer = pending.back();
+  auto newerPosition = newer->frames ? newer->frames->Position() : std::nullopt;
+  if (!newer->mergeable || newer->onDisk || newer->spilling || !newerPosition)
+    return false;
+
+  // Newest first; that is the one most likely to overlap
+  for (auto it = std::next(pending.rbegin()); it != pending.rend(); ++it)
+  {
+    auto& older = *it;
+    if (!older->mergeable || older->onDisk || older->spilling || !older->frames)
+      continue;
+    auto olderPosition = older->frames->Position();
+    if (!olderPosition || olderPosition->stream != newerPosition->stream)
+      continue;
+    if (newerPosition->first < olderPosition->first || newerPosition->first > olderPosition->first + older->frames->Size())
+      continue;
+
+    auto merged = std::make_shared<MergedClip>(older->frames, newerPosition->first - olderPosition->first, newer->frames);
+    // Only the newer job is encoded, so the older clip is saved under the
+    // newer name, with the newer trace; its own trace and ID go with it
+    spdlog::get("library")->info("Merged clip {} into {} ({} frames); {} will not be saved on its own and the trace covers only {}",
+      older->name, newer->name, merged->Size(), older->name, newer->name);
+    status.bytesInFlight -= older->bytes + newer->bytes;
+    newer->frames = merged;
+    newer->bytes = merged->Bytes();
+    status.bytesInFlight += newer->bytes;
+    pending.erase(std::next(it).base());
+    ++status.merged;
+    return true;
+  }
+  return false;
+}
+
+bool EncodeScheduler::DropOldest()
+{
+  if (pending.empty())
+    return false;
+
+  // Never the clip that was just submitted
+  for (auto it = pending.begin(); it != std::prev(pending.end()); ++it)
+  {
+    if ((*it)->spilling)
+      continue;
+    spdlog::get("library")->warn("Encode backlog over budget; dropped clip {}", (*it)->name);
+    status.bytesInFlight -= (*it)->bytes;
+    pending.erase(it);
+    ++status.dropped;
+    return true;
+  }
+  return false;
+}
+
+bool EncodeScheduler::SpillNewest()
+{
+  // The newest clip will wait the longest for an encoder, so it is the one
+  // worth paying the disk round trip for
+  for (auto it = pending.rbegin(); it != pending.rend(); ++it)
+  {
+    auto job = *it;
+    if (job->onDisk || job->spilling || !job->frames || job->frames->Size() == 0)
+      continue;
+    job->spilling = true;
+    spillingBytes += job->bytes;
+    boost::asio::post(spillPool, [this, job]() { Spill(job); });
+    return true;
+  }
+  return false;
+}
+
+void EncodeScheduler::Spill(std::shared_ptr<Job> job)
+{
+  std::shared_ptr<ClipFrames> spilled;
+  fs::path path = SPILL_PATH / fmt::format("{}.raw", spillCount++);
+  try
+  {
+    std::ofstream file(path, std::ios_base::binary);
+    cv::Mat scratch;
+    cv::Mat continuous;
+    int type = -1;
+    for (size_t i = 0; i < job->frames->Size(); ++i)
+    {
+      const cv::Mat& frame = job->frames->Get(i, scratch);
+      type = frame.type();
+      if (frame.isContinuous())
+        file.write(reinterpret_cast<const char*>(frame.data), std::streamsize(frame.total() * frame.elemSize()));
+      else
+      {
+        frame.copyTo(continuous);
+        file.write(reinterpret_cast<const char*>(continuous.data), std::streamsize(continuous.total() * continuous.elemSize()));
+      }
+    }
+    if (!file)
+      throw std::runtime_error("write failed");
+    spilled = std::make_shared<SpilledClip>(path, job->frames->Size(), job->frames->Dimensions(), type, job->frames->Position());
+  }
+  catch (std::exception& e)
+  {
+    spdlog::get("library")->error("Unable to spill clip {} to {}: {}", job->name, path.string(), e.what());
+    std::error_code error;
+    fs::remove(path, error);
+  }
+
+  std::shared_ptr<ClipFrames> original;
+  {
+    std::unique_lock lock(mutex);
+    job->spilling = false;
+    spillingBytes -= job->bytes;
+    if (spilled)
+    {
+      original = std::move(job->frames);
+      job->frames = spilled;
+      job->onDisk = true;
+      status.bytesInFlight -= job->bytes;
+      job->bytes = 0;
+      ++status.spilled;
+      spdlog::get("library")->info("Spilled clip {} to disk", job->name);
+    }
+  }
+
+  // An encoder may have passed over this job while it was being written
+  boost::asio::post(pool, [this]() { RunPending(); });
+}
+
+void EncodeScheduler::RunPending()
+{
+  std::shared_ptr<Job> job;
+  {
+    std::unique_lock lock(mutex);
+    auto it = std::find_if(pending.begin(), pending.end(), [](const auto& job) { return !job->spilling; });
+    if (it == pending.end())
+      return;
+    job = *it;
+    pending.erase(it);
+    status.queued = pending.size();
+    ++status.running;
+  }
+
+  try
+  {
+    job->encode(job->frames);
+  }
+  catch (std::exception& e)
+  {
+    spdlog::get("library")->error("Encoding clip {} failed: {}", job->name, e.what());
+  }
+
+  {
+    std::unique_lock lock(mutex);
+    --status.running;
+    status.bytesInFlight -= job->bytes;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENCODESCHEDULER_HPP
+#define ENCODESCHEDULER_HPP
+
+#include "ClipFrames.hpp"
+
+#include <boost/asio/thread_pool.hpp>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// What to do with a new clip once the queue is over its depth or memory
+// budget.  Clips that are already being encoded are never touched.
+enum class OverflowPolicy
+{
+  // Throw away the oldest queued clips until the new one fits
+  DropOldest = 0,
+  // Fold the new clip into a queued clip from the same camera it overlaps,
+  // so the overlap is neither held nor encoded twice; clips that overlap
+  // nothing fall back to DropOldest.  The merged clip is saved under the
+  // newer clip's name with only the newer clip's trace and peak.
+  Merge = 1,
+  // Write queued frames out to disk and encode from there
+  Spill = 2
+};
+
+struct EncodeBudget
+{
+  size_t threads = 5;
+  size_t maxBytes = size_t(2) << 30;
+  size_t maxQueued = 8;
+  OverflowPolicy policy = OverflowPolicy::Merge;
+};
+
+struct EncodeStatus
+{
+  size_t queued = 0;
+  size_t running = 0;
+  size_t bytesInFlight = 0;
+  size_t spilled = 0;
+  size_t dropped = 0;
+  size_t merged = 0;
+};
+
+// Queue of clips waiting to be encoded, in front of a fixed pool of encode
+// threads.  Submit() never blocks on encoding, so a backlog can only ever
+// cost clips, not capture.
+class EncodeScheduler
+{
+public:
+  using Encoder = std::function<void(std::shared_ptr<ClipFrames>)>;
+
+  EncodeScheduler(EncodeBudget budget, std::filesystem::path spillPath);
+  ~EncodeScheduler();
+
+  // encode runs on a pool thread with whatever frames the clip ends up with
+  // (merged, or read back from disk).  Jobs whose frames are only a sample of
+  // the clip (a thumbnail source, say) must not be merged.
+  void Submit(const std::string& name, std::shared_ptr<ClipFrames> frames, Encoder encode, bool mergeable = true);
+  EncodeStatus GetStatus();
+  // How many clips are being encoded right now, counting the caller's own
+  // when called from an encoder; never less than one
+  size_t GetConcurrency();
+private:
+  struct Job
+  {
+    std::string name;
+    std::shared_ptr<ClipFrames> frames;
+    Encoder encode;
+    bool mergeable;
+    // Memory charged against the budget; zero once spilled
+    size_t bytes;
+    bool spilling;
+    bool onDisk;
+  };
+
+  bool OverBudget() const;
+  void Enforce();
+  bool MergeNewest();
+  bool DropOldest();
+  bool SpillNewest();
+  void Spill(std::shared_ptr<Job> job);
+  void RunPending();
+
+  const EncodeBudget BUDGET;
+  const std::filesystem::path SPILL_PATH;
+  std::mutex mutex;
+  std::deque<std::shared_ptr<Job>> pending;
+  EncodeStatus status;
+  size_t spillingBytes;
+  uint64_t spillCount;
+  boost::asio::thread_pool spillPool;
+  boost::asio::thread_pool pool;
+};
+
+#endif
\ No newline at end of file
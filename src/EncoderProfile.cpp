@@ -0,0 +1,104 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "EncoderProfile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+#include <magic_enum.hpp>
+
+// libvpx can't split a frame into tiles narrower than this
+constexpr int MIN_TILE_WIDTH = 256;
+// Past this many threads a single encode stops getting any faster
+constexpr unsigned MAX_ENCODE_THREADS = 16;
+// Longest stretch of video between keyframes; the webm muxer indexes
+// keyframes in its Cues, so this is also the seek granularity
+constexpr double KEYFRAME_SECONDS = 1.0;
+
+struct ProfileSettings
+{
+  // VP9 splits frames into tiles and rows; VP8 only into token partitions
+  bool vp9;
+  // Constant quality; the bitrate is left at 0 so crf alone decides
+  int crf;
+  const char* deadline;
+  int cpuUsed;
+};
+
+// Indexed by EncoderProfile
+constexpr std::array<ProfileSettings, 3> PROFILES =
+{ {
+  { true,  15, "good",     1 },  // Archival
+  { true,  24, "good",     5 },  // Fast
+  { false, 10, "realtime", 8 }   // Realtime
+} };
+static_assert(PROFILES.size() == magic_enum::enum_count<EncoderProfile>());
+
+// tile-columns is given as a log2
+int TileColumnsLog2(cv::Size dimensions)
+{
+  int log2 = 0;
+  while (log2 < 6 && (MIN_TILE_WIDTH << (log2 + 1)) <= dimensions.width)
+    ++log2;
+  return log2;
+}
+
+// An even share of the cores for each encode running at the moment
+unsigned EncodeThreads(size_t concurrency)
+{
+  unsigned share = std::thread::hardware_concurrency() / std::max<size_t>(1, concurrency);
+  return std::clamp(share, 1u, MAX_ENCODE_THREADS);
+}
+
+std::string KeyframeInterval(AVRational fps)
+{
+  double frames = fps.den > 0 ? KEYFRAME_SECONDS * fps.num / fps.den : 0;
+  return std::to_string(std::max(1l, std::lround(frames)));
+}
+
+std::unique_ptr<ffmpegcpp::VideoCodec> MakeCodec(EncoderProfile profile, cv::Size dimensions, AVRational fps, size_t concurrency)
+{
+  const auto& settings = PROFILES[magic_enum::enum_index(profile).value_or(magic_enum::enum_integer(EncoderProfile::Fast))];
+  const std::string threads = std::to_string(EncodeThreads(concurrency));
+  const std::string keyframeInterval = KeyframeInterval(fps);
+
+  std::unique_ptr<ffmpegcpp::VideoCodec> codec;
+  if (settings.vp9)
+  {
+    auto vp9 = std::make_unique<ffmpegcpp::VP9Codec>();
+    vp9->SetCrf(settings.crf);
+    vp9->SetDeadline(settings.deadline);
+    vp9->SetCpuUsed(settings.cpuUsed);
+    vp9->SetOption("row-mt", 1);
+    vp9->SetOption("tile-columns", TileColumnsLog2(dimensions));
+    codec = std::move(vp9);
+  }
+  else
+  {
+    codec = std::make_unique<ffmpegcpp::VideoCodec>("libvpx");
+    codec->SetOption("crf", settings.crf);
+    codec->SetOption("deadline", settings.deadline);
+    codec->SetOption("cpu-used", settings.cpuUsed);
+    codec->SetGenericOption("slices", "8");
+  }
+  codec->SetBitRate(0);
+  codec->SetGenericOption("threads", threads.c_str());
+  codec->SetGenericOption("g", keyframeInterval.c_str());
+  return codec;
+}
\ No newline at end of file
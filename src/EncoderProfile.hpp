@@ -0,0 +1,43 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENCODERPROFILE_HPP
+#define ENCODERPROFILE_HPP
+
+#include <opencv2/core/mat.hpp>
+#include <ffmpegcpp/ffmpegcpp.h>
+#include <memory>
+
+enum class EncoderProfile
+{
+  // VP9 at high quality and a slow preset; for clips worth keeping
+  Archival = 0,
+  // VP9 with a faster preset; the default
+  Fast = 1,
+  // VP8 tuned for speed, for machines that can barely keep up
+  Realtime = 2
+};
+
+// Creates a webm codec configured for profile.  Tile columns and row-based
+// multithreading are sized for frames of the given dimensions, and threads
+// to a share of the cores with concurrency encodes running at once, so a
+// single clip encode can use more than one core without oversubscribing the
+// machine.  Keyframes come at least once a second of video at fps, so a
+// player can seek anywhere in a clip without decoding much of it.
+std::unique_ptr<ffmpegcpp::VideoCodec> MakeCodec(EncoderProfile profile, cv::Size dimensions, AVRational fps, size_t concurrency);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FFMPEGUTILS_HPP
+#define FFMPEGUTILS_HPP
+
+#include <ffmpegcpp/ffmpegcpp.h>
+#include <cmath>
+
+// Translated to constexpr from
+// https://rosettacode.org/wiki/Convert_decimal_number_to_rational#C
+// I have pretty much no idea how this works...but it do
+inline const AVRational NearestRational(double f)
+{
+  int h[3] = { 0, 1, 0 };
+  int k[3] = { 1, 0, 0 };
+  int n = 1;
+  int neg = 0;
+  int md = 16;
+
+  if (f < 0)
+  {
+    neg = 1;
+    f = -f;
+  }
+
+  while (f != floor(f))
+  {
+    n <<= 1;
+    f *= 2;
+  }
+  int d = f;
+  
+  for (int i = 0; i < 64; ++i)
+  {
+    int a = n ? d / n : 0;
+    if (i && !a)
+      break;
+
+    int x = d;
+    d = n;
+    n = x % n;
+
+    x = a;
+    if (k[1] * a + k[0] >= md)
+    {
+      x = (md - k[0]) / k[1];
+      if (x * 2 >= a || k[1] >= md)
+        i = 65;
+      else
+        break;
+    }
+
+    h[2] = x * h[1] + h[0]; h[0] = h[1]; h[1] = h[2];
+    k[2] = x * k[1] + k[0]; k[0] = k[1]; k[1] = k[2];
+  }
+
+  return AVRational { neg ? -h[1] : h[1], k[1] };
+}
+
+constexpr AVRational Inverse(const AVRational& v)
+{
+  return AVRational { v.den, v.num };
+}
+
+#endif
\ No newline at end of file
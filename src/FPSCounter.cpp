@@ -21,7 +21,7 @@ using ms = std::chrono::duration<double, std::milli>;
 
 FPSCounter::FPSCounter(size_t samplesToAverage)
   : lastFrame(std::chrono::high_resolution_clock::now()),
-    samples(samplesToAverage, 0.0)
+    samples(samplesToAverage)
 {
 }
 
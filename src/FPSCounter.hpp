@@ -20,7 +20,7 @@
 
 #include <chrono>
 
-#include "MovingAverage.hpp"
+#include "RollingStatistics.hpp"
 
 class FPSCounter
 {
@@ -32,7 +32,7 @@ public:
   double GetFPSAveraged() const;
 private:
   std::chrono::time_point<std::chrono::high_resolution_clock> lastFrame;
-  MovingAverage<double> samples;
+  RollingStatistics<double> samples;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FrameAnalyzer.hpp"
+
+#include "Intensity.hpp"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <spdlog/spdlog.h>
+
+// BG and RG mosaics keep green off the diagonal of each 2x2 superpixel; GB
+// and GR keep it on.  OpenCV's one pixel offset in naming preserves this.
+bool GreenOnDiagonal(BayerMode mode)
+{
+  return mode == BayerMode::GB || mode == BayerMode::GR;
+}
+
+bool CommitFrame(cv::Mat& raw, std::optional<BayerMode> bayerMode, cv::Size resolution, FrameHistory& frames)
+{
+  if (!bayerMode)
+    return frames.Adopt(raw);
+
+  const cv::Mat mosaic = raw.reshape(0, resolution.height);
+  cv::Mat& converted = frames.Next();
+  switch (bayerMode.value())
+  {
+  default:
+  case BayerMode::GB:
+    cv::cvtColor(mosaic, converted, cv::COLOR_BayerGB2BGR);
+    break;
+  case BayerMode::BG:
+    cv::cvtColor(mosaic, converted, cv::COLOR_BayerBG2BGR);
+    break;
+  case BayerMode::RG:
+    cv::cvtColor(mosaic, converted, cv::COLOR_BayerRG2BGR);
+    break;
+  case BayerMode::GR:
+    cv::cvtColor(mosaic, converted, cv::COLOR_BayerGR2BGR);
+    break;
+  }
+  return frames.Commit();
+}
+
+FrameAnalyzer::FrameAnalyzer(cv::Size resolution, std::optional<BayerMode> bayerMode, double fps, size_t clipFrames)
+  : RESOLUTION(resolution),
+    BAYER_MODE(bayerMode),
+    FPS(fps),
+    analysisDecimation(1),
+    tileGrid(1, 1),
+    trace(clipFrames)
+{
+}
+
+void FrameAnalyzer::Configure(const std::function<double(CameraProperty)>& property)
+{
+  auto detector = magic_enum::enum_cast<DetectorMode>(property(CameraProperty::DetectorMode)).value_or(DetectorMode::Brightness);
+  // Tiles never get smaller than a Bayer superpixel, or a pixel of the
+  // reduced copy when differencing
+  cv::Size maxGrid(std::max(1, RESOLUTION.width / 2), std::max(1, RESOLUTION.height / 2));
+  difference.reset();
+  if (detector == DetectorMode::FrameDifference)
+  {
+    unsigned scale = std::max(1.0, property(CameraProperty::DifferenceScale));
+    // Keep each reduced pixel to whole superpixels
+    if (BAYER_MODE && scale > 1)
+      scale += scale % 2;
+    difference = std::make_unique<FrameDifference>(scale);
+    maxGrid = difference->MaxGrid(RESOLUTION);
+  }
+  tileGrid = cv::Size(
+    std::clamp<int>(property(CameraProperty::TileColumns), 1, maxGrid.width),
+    std::clamp<int>(property(CameraProperty::TileRows), 1, maxGrid.height));
+  trigger = std::make_unique<VideoTrigger>(
+    FPS,
+    property(CameraProperty::EdgeDetectionSeconds),
+    property(CameraProperty::DebounceSeconds),
+    property(CameraProperty::TriggerDelay),
+    property(CameraProperty::TriggerThreshold),
+    magic_enum::enum_cast<TriggerMode>(property(CameraProperty::TriggerMode)).value_or(TriggerMode::Threshold),
+    property(CameraProperty::ZScoreThreshold),
+    tileGrid.area());
+  trace.Reset(tileGrid.width, tileGrid.height);
+  analysisDecimation = std::max(1.0, property(CameraProperty::AnalysisDecimation));
+}
+
+void FrameAnalyzer::Measure(const cv::Mat& raw)
+{
+  // The trigger only needs brightness, which the raw mosaic already has
+  const cv::Mat mosaic = BAYER_MODE ? raw.reshape(0, RESOLUTION.height) : cv::Mat();
+  if (difference)
+    difference->Update(BAYER_MODE ? mosaic : raw, tileGrid, intensities);
+  else if (BAYER_MODE && tileGrid.area() == 1)
+    intensities.assign(1, MeanBayerIntensity(mosaic, GreenOnDiagonal(BAYER_MODE.value()), analysisDecimation));
+  else if (BAYER_MODE)
+    TileBayerIntensities(mosaic, GreenOnDiagonal(BAYER_MODE.value()), tileGrid, intensities, analysisDecimation);
+  else if (tileGrid.area() == 1)
+    intensities.assign(1, MeanIntensity(raw, analysisDecimation));
+  else
+    TileIntensities(raw, tileGrid, intensities, analysisDecimation);
+}
+
+bool FrameAnalyzer::ShouldCapture()
+{
+  if (!trigger)
+    return false;
+
+  bool capture = trigger->ShouldCapture(intensities);
+  trace.Push(intensities, trigger->GetBaselines(),
+    (trigger->WasArmed() ? TRACE_ARMED : 0) |
+    (trigger->WasSpike() ? TRACE_SPIKE : 0) |
+    (capture ? TRACE_CAPTURE : 0));
+  return capture;
+}
+
+size_t FrameAnalyzer::GetPeakSeekBack() const
+{
+  return trigger ? trigger->GetPeakSeekBack() : 1;
+}
+
+std::string FrameAnalyzer::GetTrace() const
+{
+  return trace.Serialize(FPS, GetPeakSeekBack());
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMEANALYZER_HPP
+#define FRAMEANALYZER_HPP
+
+#include "Camera.hpp"
+#include "FrameDifference.hpp"
+#include "FrameHistory.hpp"
+#include "IntensityTrace.hpp"
+#include "VideoTrigger.hpp"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+// Adds a frame as grabbed (BGR, or a Bayer mosaic when bayerMode is set) to
+// the history as BGR.  Mosaics are demosaiced straight into the next slot;
+// BGR frames are adopted, so raw may come back holding a different buffer.
+bool CommitFrame(cv::Mat& raw, std::optional<BayerMode> bayerMode, cv::Size resolution, FrameHistory& frames);
+
+// The detection half of the conversion stage: measures each frame's
+// brightness (whole or in tiles, directly or against the last frame), runs
+// the trigger over it and keeps the trace saved with each clip.  Cameras
+// and the replay harness both go through this, so they detect alike.
+class FrameAnalyzer
+{
+public:
+  FrameAnalyzer(cv::Size resolution, std::optional<BayerMode> bayerMode, double fps, size_t clipFrames);
+
+  // Takes up the trigger and detector properties; the baseline starts over
+  void Configure(const std::function<double(CameraProperty)>& property);
+  // Reads the frame's brightness; the raw buffer can be reused afterwards
+  void Measure(const cv::Mat& raw);
+  // Once the frame has joined the history, whether a clip should be saved
+  // ending with it
+  bool ShouldCapture();
+
+  // For the clip just captured
+  size_t GetPeakSeekBack() const;
+  std::string GetTrace() const;
+private:
+  const cv::Size RESOLUTION;
+  const std::optional<BayerMode> BAYER_MODE;
+  const double FPS;
+
+  unsigned analysisDecimation;
+  cv::Size tileGrid;
+  std::unique_ptr<FrameDifference> difference;
+  std::unique_ptr<VideoTrigger> trigger;
+  std::vector<double> intensities;
+  IntensityTrace trace;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FrameDifference.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+#include "Intensity.hpp"
+
+FrameDifference::FrameDifference(unsigned scale)
+  : SCALE(std::max(1u, scale))
+{
+}
+
+cv::Size FrameDifference::ReducedSize(cv::Size frameSize) const
+{
+  return cv::Size(std::max<int>(1, frameSize.width / SCALE), std::max<int>(1, frameSize.height / SCALE));
+}
+
+cv::Size FrameDifference::MaxGrid(cv::Size frameSize) const
+{
+  return ReducedSize(frameSize);
+}
+
+void FrameDifference::Update(const cv::Mat& frame, cv::Size grid, std::vector<double>& differences)
+{
+  // Area averaging reads every source pixel once; for a Bayer mosaic and an
+  // even scale each output pixel covers whole superpixels, so it comes out as
+  // plain brightness
+  if (SCALE == 1)
+    frame.copyTo(current);
+  else
+    cv::resize(frame, current, ReducedSize(frame.size()), 0, 0, cv::INTER_AREA);
+
+  if (previous.empty() || previous.size() != current.size() || previous.type() != current.type())
+  {
+    grid = cv::Size(std::clamp(grid.width, 1, current.cols), std::clamp(grid.height, 1, current.rows));
+    differences.assign(size_t(grid.area()), 0);
+  }
+  else
+    TileDifferences(previous, current, grid, differences);
+
+  std::swap(previous, current);
+}
\ No newline at end of file
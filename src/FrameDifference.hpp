@@ -0,0 +1,47 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMEDIFFERENCE_HPP
+#define FRAMEDIFFERENCE_HPP
+
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+// Measures how much a frame changed since the last one.  Frames are first
+// shrunk by an integer factor, which both cuts the cost of the comparison and
+// averages away per-pixel sensor noise; the shrunken copies are then compared
+// with the SIMD abs-diff kernel.
+class FrameDifference
+{
+public:
+  explicit FrameDifference(unsigned scale = 4);
+
+  // Mean absolute change per byte for each tile of the grid.  The first
+  // frame (or the first after the size changes) reports no change.
+  void Update(const cv::Mat& frame, cv::Size grid, std::vector<double>& differences);
+
+  // Largest grid Update can report for a frame of the given size
+  cv::Size MaxGrid(cv::Size frameSize) const;
+private:
+  cv::Size ReducedSize(cv::Size frameSize) const;
+
+  const unsigned SCALE;
+  cv::Mat previous;
+  cv::Mat current;
+};
+
+#endif
\ No newline at end of file
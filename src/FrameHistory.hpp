@@ -0,0 +1,67 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMEHISTORY_HPP
+#define FRAMEHISTORY_HPP
+
+#include "ClipFrames.hpp"
+
+#include <opencv2/core/mat.hpp>
+#include <atomic>
+#include <memory>
+
+// The pre-trigger history kept by a camera.  The capture loop writes each
+// frame into Next() and publishes it with Commit(), or hands over a frame it
+// already has with Adopt(), and asks for a Snapshot()
+// of everything buffered when the trigger fires, or of just the newest
+// frames.  PinNewest() hands out the newest frame uncompressed, for consumers
+// that need pixels rather than a clip.
+class FrameHistory
+{
+public:
+  virtual ~FrameHistory() = default;
+
+  virtual cv::Mat& Next() = 0;
+  virtual bool Commit() = 0;
+  // Publishes frame as the newest frame.  Histories that can take frame's
+  // buffer over swap it for a free one of the same size instead of copying,
+  // so the caller must not hold any other reference to that buffer.
+  virtual bool Adopt(cv::Mat& frame)
+  {
+    frame.copyTo(Next());
+    return Commit();
+  }
+  virtual const cv::Mat& Newest() const = 0;
+  virtual std::shared_ptr<ClipFrames> Snapshot(size_t newest) const = 0;
+  virtual std::shared_ptr<ClipFrames> PinNewest() const = 0;
+  virtual size_t Size() const = 0;
+  virtual size_t Capacity() const = 0;
+
+  std::shared_ptr<ClipFrames> Snapshot() const
+  {
+    return Snapshot(Size());
+  }
+protected:
+  // Identifies a history in the ClipPosition of its snapshots
+  static uint64_t NewStreamID()
+  {
+    static std::atomic<uint64_t> next(0);
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+#endif
\ No newline at end of file
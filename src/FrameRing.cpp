@@ -0,0 +1,364 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FrameRing.hpp"
+
+#include <new>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "Platform.hpp"
+
+// Page aligned slots keep every frame row SIMD friendly and let the kernel
+// back the slab with huge pages without splitting frames across them
+constexpr size_t SLOT_ALIGNMENT = 4096;
+
+constexpr size_t AlignUp(size_t value, size_t alignment)
+{
+  return ((value + alignment - 1) / alignment) * alignment;
+}
+
+FrameRing::Slot::Slot(cv::Size dimensions, int type, uchar* memory)
+  : mat(dimensions, type, memory),
+    home(mat),
+    pins(0),
+    overflow(false)
+{
+}
+
+FrameRing::Slot::Slot(cv::Size dimensions, int type)
+  : mat(dimensions, type),
+    home(mat),
+    pins(0),
+    overflow(true)
+{
+}
+
+FrameRing::Storage::Storage(size_t slabBytes, bool hugePages)
+  : slabBytes(slabBytes),
+    slab(static_cast<uchar*>(AllocateSlab(slabBytes, hugePages)))
+{
+  if (slab == nullptr)
+    throw std::bad_alloc();
+}
+
+FrameRing::Storage::~Storage()
+{
+  slots.clear();
+  overflow.clear();
+  FreeSlab(slab, slabBytes);
+}
+
+class FrameRing::Clip : public ClipFrames
+{
+public:
+  Clip(std::shared_ptr<Storage> storage, std::vector<Slot*> slots, cv::Size dimensions, size_t frameBytes, ClipPosition position)
+    : storage(storage),
+      slots(std::move(slots)),
+      pinned(this->slots.size(), true),
+      dimensions(dimensions),
+      frameBytes(frameBytes),
+      position(position)
+  {
+  }
+
+  ~Clip()
+  {
+    for (size_t i = 0; i < slots.size(); ++i)
+      Release(i);
+  }
+
+  size_t Size() const override
+  {
+    return slots.size();
+  }
+
+  cv::Size Dimensions() const override
+  {
+    return dimensions;
+  }
+
+  size_t Bytes() const override
+  {
+    return frameBytes * std::count(pinned.begin(), pinned.end(), true);
+  }
+
+  const cv::Mat& Get(size_t index, cv::Mat& scratch) const override
+  {
+    (void)scratch;
+    return slots[index]->mat;
+  }
+
+  void Release(size_t index) override
+  {
+    if (pinned[index])
+    {
+      slots[index]->pins.fetch_sub(1, std::memory_order_release);
+      pinned[index] = false;
+    }
+  }
+
+  std::optional<ClipPosition> Position() const override
+  {
+    return position;
+  }
+private:
+  std::shared_ptr<Storage> storage;
+  std::vector<Slot*> slots;
+  std::vector<bool> pinned;
+  cv::Size dimensions;
+  size_t frameBytes;
+  ClipPosition position;
+};
+
+FrameRing::FrameRing(cv::Size dimensions, int type, size_t capacity, size_t spareSlots, bool hugePages)
+  : dimensions(dimensions),
+    type(type),
+    frameBytes(size_t(dimensions.area()) * CV_ELEM_SIZE(type)),
+    slotStride(AlignUp(frameBytes, SLOT_ALIGNMENT)),
+    // The ring, its spares and one slot that dropped frames are written to
+    storage(std::make_shared<Storage>(slotStride * (capacity + spareSlots + 1), hugePages)),
+    discard(nullptr),
+    dropping(false),
+    dropped(0),
+    borrowed(0),
+    head(0),
+    count(0),
+    stream(NewStreamID()),
+    committed(0)
+{
+  // Headers only; the slab itself is left untouched until frames land in it
+  order.reserve(capacity);
+  spares.reserve(spareSlots);
+  for (size_t i = 0; i < capacity + spareSlots + 1; ++i)
+  {
+    Slot* slot = &storage->slots.emplace_back(dimensions, type, storage->slab + i * slotStride);
+    if (i < capacity)
+      order.push_back(slot);
+    else if (i < capacity + spareSlots)
+      spares.push_back(slot);
+    else
+      discard = slot;
+  }
+}
+
+FrameRing::~FrameRing()
+{
+}
+
+FrameRing::Slot* FrameRing::TakeSpare()
+{
+  for (auto it = spares.begin(); it != spares.end(); ++it)
+  {
+    if ((*it)->pins.load(std::memory_order_acquire) == 0)
+    {
+      Slot* spare = *it;
+      spares.erase(it);
+      return spare;
+    }
+  }
+  return nullptr;
+}
+
+FrameRing::Slot* FrameRing::Borrow()
+{
+  try
+  {
+    Slot* slot = storage->overflow.emplace_back(std::make_unique<Slot>(dimensions, type)).get();
+    if (borrowed++ == 0)
+      spdlog::get("camera")->warn("Frame ring spares are all pinned; borrowing frames until a save releases some");
+    return slot;
+  }
+  catch (const std::exception&)
+  {
+    // Out of memory; the caller drops the frame instead
+    return nullptr;
+  }
+}
+
+void FrameRing::GiveBack(Slot*& slot)
+{
+  auto& overflow = storage->overflow;
+  auto release = [&overflow](Slot* spare)
+  {
+    overflow.erase(std::find_if(overflow.begin(), overflow.end(), [spare](const auto& owned) { return owned.get() == spare; }));
+  };
+
+  // Borrowed spares go back as soon as nothing pins them
+  spares.erase(std::remove_if(spares.begin(), spares.end(), [&release](Slot* spare)
+  {
+    if (!spare->overflow || spare->pins.load(std::memory_order_acquire) != 0)
+      return false;
+    release(spare);
+    return true;
+  }), spares.end());
+
+  // A borrowed slot still in the ring makes way for a free one from the slab;
+  // its frame is the oldest and about to be written over anyway
+  if (slot->overflow)
+  {
+    if (Slot* spare = TakeSpare(); spare != nullptr)
+    {
+      release(slot);
+      slot = spare;
+    }
+  }
+
+  if (overflow.empty())
+  {
+    spdlog::get("camera")->info("Frame ring back within its slab after borrowing {} frames", borrowed);
+    borrowed = 0;
+  }
+}
+
+cv::Mat& FrameRing::Next()
+{
+  Slot*& slot = order[head];
+  dropping = false;
+  if (slot->pins.load(std::memory_order_acquire) != 0)
+  {
+    // Every spare is still pinned by a save in progress, so one is borrowed;
+    // only if that fails is the frame written somewhere harmless for Commit()
+    // to drop
+    Slot* spare = TakeSpare();
+    if (spare == nullptr)
+      spare = Borrow();
+    if (spare == nullptr)
+    {
+      dropping = true;
+      return discard->mat;
+    }
+    spares.push_back(slot);
+    slot = spare;
+  }
+  else if (!storage->overflow.empty())
+    GiveBack(slot);
+  return slot->mat;
+}
+
+bool FrameRing::Commit()
+{
+  if (dropping)
+  {
+    discard->mat = discard->home;
+    if (dropped++ == 0)
+      spdlog::get("camera")->warn("Out of memory for frames; dropping frames until a save releases some");
+    return false;
+  }
+  if (dropped != 0)
+  {
+    spdlog::get("camera")->info("Frame ring resumed after dropping {} frames", dropped);
+    dropped = 0;
+  }
+
+  Slot* slot = order[head];
+  bool accepted = true;
+
+  // Whoever wrote the frame reallocated the header (different size or type)
+  // instead of filling the slot; pull it back into place if we can
+  if (slot->mat.data != slot->home.data)
+  {
+    if (slot->mat.size() == dimensions && slot->mat.type() == type)
+      slot->mat.copyTo(slot->home);
+    else
+    {
+      spdlog::get("camera")->warn("ERROR! frame does not match negotiated resolution");
+      accepted = false;
+    }
+    slot->mat = slot->home;
+  }
+
+  if (accepted)
+  {
+    head = (head + 1) % order.size();
+    if (count < order.size())
+      ++count;
+    ++committed;
+  }
+  return accepted;
+}
+
+bool FrameRing::Adopt(cv::Mat& frame)
+{
+  // Only a buffer laid out exactly like a slot can take a slot's place
+  if (frame.size() != dimensions || frame.type() != type || !frame.isContinuous())
+    return FrameHistory::Adopt(frame);
+
+  // The slot's buffer goes back to the caller and the frame's buffer becomes
+  // the slot; the two keep trading places from then on
+  cv::Mat& slot = Next();
+  if (!dropping)
+  {
+    std::swap(slot, frame);
+    order[head]->home = slot;
+  }
+  return Commit();
+}
+
+const cv::Mat& FrameRing::Newest() const
+{
+  return order[(head + order.size() - 1) % order.size()]->mat;
+}
+
+const cv::Mat& FrameRing::operator[](size_t index) const
+{
+  return order[(head + order.size() - count + index) % order.size()]->mat;
+}
+
+std::shared_ptr<ClipFrames> FrameRing::Snapshot(size_t newest) const
+{
+  newest = std::min(newest, count);
+  std::vector<Slot*> slots;
+  slots.reserve(newest);
+  for (size_t i = 0; i < newest; ++i)
+  {
+    Slot* slot = order[(head + order.size() - newest + i) % order.size()];
+    slot->pins.fetch_add(1, std::memory_order_relaxed);
+    slots.push_back(slot);
+  }
+  return std::make_shared<Clip>(storage, std::move(slots), dimensions, frameBytes, ClipPosition{ stream, committed - newest });
+}
+
+std::shared_ptr<ClipFrames> FrameRing::PinNewest() const
+{
+  return Snapshot(1);
+}
+
+size_t FrameRing::Size() const
+{
+  return count;
+}
+
+size_t FrameRing::Capacity() const
+{
+  return order.size();
+}
+
+size_t FrameRing::FrameBytes() const
+{
+  return frameBytes;
+}
+
+size_t FrameRing::SpareCount() const
+{
+  return spares.size();
+}
+
+size_t FrameRing::SlotCount() const
+{
+  return storage->slots.size() + storage->overflow.size();
+}
\ No newline at end of file
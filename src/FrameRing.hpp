@@ -0,0 +1,111 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMERING_HPP
+#define FRAMERING_HPP
+
+#include "FrameHistory.hpp"
+
+#include <opencv2/core/mat.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Fixed capacity ring of frames carved out of a single slab.  Frames are
+// written in place through Next() and published with Commit(), or swapped in
+// whole by Adopt(); nothing is allocated or zeroed per frame.
+//
+// Snapshot() pins the current contents instead of copying them.  While a slot
+// is pinned the ring writes into a spare slot in its place, so a clip can be
+// encoded straight out of the ring while capture carries on.  The spares are
+// reserved in the slab up front; once they are all pinned as well the ring
+// borrows extra slots from the heap, so capture never waits on the encoder.
+// The encode scheduler's budget bounds how many snapshots stay pinned, and the
+// extra slots are handed back as soon as the slab has room again.
+class FrameRing : public FrameHistory
+{
+public:
+  FrameRing(cv::Size dimensions, int type, size_t capacity, size_t spareSlots, bool hugePages = false);
+  FrameRing(const FrameRing&) = delete;
+  FrameRing& operator=(const FrameRing&) = delete;
+  virtual ~FrameRing();
+
+  cv::Mat& Next() override;
+  bool Commit() override;
+  bool Adopt(cv::Mat& frame) override;
+  const cv::Mat& Newest() const override;
+  const cv::Mat& operator[](size_t index) const;
+  std::shared_ptr<ClipFrames> Snapshot(size_t newest) const override;
+  using FrameHistory::Snapshot;
+  std::shared_ptr<ClipFrames> PinNewest() const override;
+  size_t Size() const override;
+  size_t Capacity() const override;
+  size_t FrameBytes() const;
+  size_t SpareCount() const;
+  size_t SlotCount() const;
+private:
+  struct Slot
+  {
+    Slot(cv::Size dimensions, int type, uchar* memory);
+    Slot(cv::Size dimensions, int type);
+
+    cv::Mat mat;
+    // The buffer the slot owns: a piece of the slab, or a buffer handed over
+    // by Adopt() in exchange for it
+    cv::Mat home;
+    std::atomic<unsigned> pins;
+    // Borrowed from the heap once every spare in the slab was pinned
+    const bool overflow;
+  };
+
+  // Outlives the ring for as long as any snapshot still pins a slot
+  struct Storage
+  {
+    Storage(size_t slabBytes, bool hugePages);
+    ~Storage();
+
+    const size_t slabBytes;
+    uchar* slab;
+    std::deque<Slot> slots;
+    std::vector<std::unique_ptr<Slot>> overflow;
+  };
+
+  class Clip;
+
+  Slot* TakeSpare();
+  Slot* Borrow();
+  void GiveBack(Slot*& slot);
+
+  const cv::Size dimensions;
+  const int type;
+  const size_t frameBytes;
+  const size_t slotStride;
+  std::shared_ptr<Storage> storage;
+  std::vector<Slot*> order;
+  std::vector<Slot*> spares;
+  Slot* discard;
+  bool dropping;
+  size_t dropped;
+  size_t borrowed;
+  size_t head;
+  size_t count;
+  const uint64_t stream;
+  uint64_t committed;
+};
+
+#endif
\ No newline at end of file
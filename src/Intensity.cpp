@@ -0,0 +1,499 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Intensity.hpp"
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define INTENSITY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define INTENSITY_TARGET_AVX2
+#else
+#define INTENSITY_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define INTENSITY_NEON
+#include <arm_neon.h>
+#endif
+
+using SumKernel = uint64_t (*)(const uint8_t*, size_t);
+using InterleavedKernel = void (*)(const uint8_t*, size_t, uint64_t&, uint64_t&);
+using AbsDiffKernel = uint64_t (*)(const uint8_t*, const uint8_t*, size_t);
+
+uint64_t SumBytesScalar(const uint8_t* data, size_t length)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < length; ++i)
+    sum += data[i];
+  return sum;
+}
+
+void SumBytesInterleavedScalar(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd)
+{
+  uint64_t evenSum = 0;
+  uint64_t oddSum = 0;
+  size_t i = 0;
+  for (; i + 2 <= length; i += 2)
+  {
+    evenSum += data[i];
+    oddSum += data[i + 1];
+  }
+  if (i < length)
+    evenSum += data[i];
+  even = evenSum;
+  odd = oddSum;
+}
+
+uint64_t SumAbsDiffScalar(const uint8_t* a, const uint8_t* b, size_t length)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < length; ++i)
+    sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+  return sum;
+}
+
+#ifdef INTENSITY_X86
+// psadbw against zero adds up 8 bytes at a time into 64-bit lanes, so there
+// is no intermediate widening and no overflow to worry about
+uint64_t SumBytesSSE2(const uint8_t* data, size_t length)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i accA = zero;
+  __m128i accB = zero;
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    accA = _mm_add_epi64(accA, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), zero));
+    accB = _mm_add_epi64(accB, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16)), zero));
+  }
+  for (; i + 16 <= length; i += 16)
+    accA = _mm_add_epi64(accA, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), zero));
+
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(accA, accB));
+  return lanes[0] + lanes[1] + SumBytesScalar(data + i, length - i);
+}
+
+// Masking off the high byte of every 16-bit lane leaves just the even bytes;
+// odd is whatever is left over from the full sum
+void SumBytesInterleavedSSE2(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i evenMask = _mm_set1_epi16(0x00FF);
+  __m128i accEven = zero;
+  __m128i accAll = zero;
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    accEven = _mm_add_epi64(accEven, _mm_sad_epu8(_mm_and_si128(v, evenMask), zero));
+    accAll = _mm_add_epi64(accAll, _mm_sad_epu8(v, zero));
+  }
+
+  alignas(16) uint64_t evenLanes[2];
+  alignas(16) uint64_t allLanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(evenLanes), accEven);
+  _mm_store_si128(reinterpret_cast<__m128i*>(allLanes), accAll);
+  SumBytesInterleavedScalar(data + i, length - i, even, odd);
+  even += evenLanes[0] + evenLanes[1];
+  odd += allLanes[0] + allLanes[1] - (evenLanes[0] + evenLanes[1]);
+}
+
+// The same instruction with a second operand is exactly the abs-diff sum
+uint64_t SumAbsDiffSSE2(const uint8_t* a, const uint8_t* b, size_t length)
+{
+  __m128i acc = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16)
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return lanes[0] + lanes[1] + SumAbsDiffScalar(a + i, b + i, length - i);
+}
+
+INTENSITY_TARGET_AVX2 uint64_t SumBytesAVX2(const uint8_t* data, size_t length)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i accA = zero;
+  __m256i accB = zero;
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64)
+  {
+    accA = _mm256_add_epi64(accA, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), zero));
+    accB = _mm256_add_epi64(accB, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32)), zero));
+  }
+  for (; i + 32 <= length; i += 32)
+    accA = _mm256_add_epi64(accA, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), zero));
+
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(accA, accB));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumBytesSSE2(data + i, length - i);
+}
+
+INTENSITY_TARGET_AVX2 void SumBytesInterleavedAVX2(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i evenMask = _mm256_set1_epi16(0x00FF);
+  __m256i accEven = zero;
+  __m256i accAll = zero;
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    accEven = _mm256_add_epi64(accEven, _mm256_sad_epu8(_mm256_and_si256(v, evenMask), zero));
+    accAll = _mm256_add_epi64(accAll, _mm256_sad_epu8(v, zero));
+  }
+
+  alignas(32) uint64_t evenLanes[4];
+  alignas(32) uint64_t allLanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(evenLanes), accEven);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(allLanes), accAll);
+  // i is a multiple of 32, so the tail keeps the same even/odd phase
+  SumBytesInterleavedSSE2(data + i, length - i, even, odd);
+  uint64_t evenSum = evenLanes[0] + evenLanes[1] + evenLanes[2] + evenLanes[3];
+  even += evenSum;
+  odd += allLanes[0] + allLanes[1] + allLanes[2] + allLanes[3] - evenSum;
+}
+
+INTENSITY_TARGET_AVX2 uint64_t SumAbsDiffAVX2(const uint8_t* a, const uint8_t* b, size_t length)
+{
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32)
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumAbsDiffSSE2(a + i, b + i, length - i);
+}
+
+bool HasAVX2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef INTENSITY_NEON
+uint64_t SumBytesNEON(const uint8_t* data, size_t length)
+{
+  uint64x2_t acc = vdupq_n_u64(0);
+  size_t i = 0;
+  while (i + 16 <= length)
+  {
+    // 16-bit lanes can take 128 pairwise byte sums before they could overflow
+    uint16x8_t partial = vdupq_n_u16(0);
+    size_t blockEnd = std::min(length - length % 16, i + 16 * 128);
+    for (; i < blockEnd; i += 16)
+      partial = vpadalq_u8(partial, vld1q_u8(data + i));
+    acc = vpadalq_u32(acc, vpaddlq_u16(partial));
+  }
+  return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) + SumBytesScalar(data + i, length - i);
+}
+
+void SumBytesInterleavedNEON(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd)
+{
+  uint64x2_t accEven = vdupq_n_u64(0);
+  uint64x2_t accOdd = vdupq_n_u64(0);
+  size_t i = 0;
+  while (i + 16 <= length)
+  {
+    // 32-bit lanes take 2 * 255 per step; flush them well before overflow
+    uint32x4_t partialEven = vdupq_n_u32(0);
+    uint32x4_t partialOdd = vdupq_n_u32(0);
+    size_t blockEnd = std::min(length - length % 16, i + 16 * 65536);
+    for (; i < blockEnd; i += 16)
+    {
+      uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(data + i));
+      partialEven = vpadalq_u16(partialEven, vandq_u16(v, vdupq_n_u16(0x00FF)));
+      partialOdd = vpadalq_u16(partialOdd, vshrq_n_u16(v, 8));
+    }
+    accEven = vpadalq_u32(accEven, partialEven);
+    accOdd = vpadalq_u32(accOdd, partialOdd);
+  }
+  SumBytesInterleavedScalar(data + i, length - i, even, odd);
+  even += vgetq_lane_u64(accEven, 0) + vgetq_lane_u64(accEven, 1);
+  odd += vgetq_lane_u64(accOdd, 0) + vgetq_lane_u64(accOdd, 1);
+}
+
+uint64_t SumAbsDiffNEON(const uint8_t* a, const uint8_t* b, size_t length)
+{
+  uint64x2_t acc = vdupq_n_u64(0);
+  size_t i = 0;
+  while (i + 16 <= length)
+  {
+    uint16x8_t partial = vdupq_n_u16(0);
+    size_t blockEnd = std::min(length - length % 16, i + 16 * 128);
+    for (; i < blockEnd; i += 16)
+      partial = vpadalq_u8(partial, vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    acc = vpadalq_u32(acc, vpaddlq_u16(partial));
+  }
+  return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) + SumAbsDiffScalar(a + i, b + i, length - i);
+}
+#endif
+
+struct Kernel
+{
+  SumKernel sum;
+  InterleavedKernel interleaved;
+  AbsDiffKernel absDiff;
+  std::string_view name;
+};
+
+Kernel SelectKernel()
+{
+#if defined(INTENSITY_X86)
+  if (HasAVX2())
+    return { SumBytesAVX2, SumBytesInterleavedAVX2, SumAbsDiffAVX2, "avx2" };
+  return { SumBytesSSE2, SumBytesInterleavedSSE2, SumAbsDiffSSE2, "sse2" };
+#elif defined(INTENSITY_NEON)
+  return { SumBytesNEON, SumBytesInterleavedNEON, SumAbsDiffNEON, "neon" };
+#else
+  return { SumBytesScalar, SumBytesInterleavedScalar, SumAbsDiffScalar, "scalar" };
+#endif
+}
+
+const Kernel& ActiveKernel()
+{
+  static const Kernel kernel = SelectKernel();
+  return kernel;
+}
+
+uint64_t SumBytes(const uint8_t* data, size_t length)
+{
+  return ActiveKernel().sum(data, length);
+}
+
+void SumBytesInterleaved(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd)
+{
+  ActiveKernel().interleaved(data, length, even, odd);
+}
+
+uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t length)
+{
+  return ActiveKernel().absDiff(a, b, length);
+}
+
+std::string_view IntensityKernelName()
+{
+  return ActiveKernel().name;
+}
+
+double MeanIntensity(const cv::Mat& frame, unsigned decimation)
+{
+  CV_Assert(frame.depth() == CV_8U);
+  if (frame.empty())
+    return 0;
+  decimation = std::max(1u, decimation);
+
+  const size_t rowBytes = size_t(frame.cols) * frame.channels();
+  if (decimation == 1 && frame.isContinuous())
+    return double(SumBytes(frame.data, rowBytes * frame.rows)) / double(rowBytes * frame.rows);
+
+  uint64_t sum = 0;
+  size_t samples = 0;
+  for (int row = 0; row < frame.rows; row += decimation)
+  {
+    sum += SumBytes(frame.ptr<uint8_t>(row), rowBytes);
+    samples += rowBytes;
+  }
+  return double(sum) / double(samples);
+}
+
+double MeanBayerIntensity(const cv::Mat& mosaic, bool greenOnDiagonal, unsigned decimation)
+{
+  CV_Assert(mosaic.depth() == CV_8U && mosaic.channels() == 1);
+  decimation = std::max(1u, decimation);
+
+  // Only whole superpixels count
+  const size_t rowBytes = size_t(mosaic.cols) & ~size_t(1);
+  const int rows = mosaic.rows & ~1;
+  if (rowBytes == 0 || rows == 0)
+    return 0;
+
+  uint64_t green = 0;
+  uint64_t other = 0;
+  size_t superpixels = 0;
+  for (int row = 0; row < rows; row += 2 * decimation)
+  {
+    uint64_t evenTop, oddTop, evenBottom, oddBottom;
+    SumBytesInterleaved(mosaic.ptr<uint8_t>(row), rowBytes, evenTop, oddTop);
+    SumBytesInterleaved(mosaic.ptr<uint8_t>(row + 1), rowBytes, evenBottom, oddBottom);
+
+    // Green sites sit on one diagonal of the superpixel, red and blue on the other
+    if (greenOnDiagonal)
+    {
+      green += evenTop + oddBottom;
+      other += oddTop + evenBottom;
+    }
+    else
+    {
+      green += oddTop + evenBottom;
+      other += evenTop + oddBottom;
+    }
+    superpixels += rowBytes / 2;
+  }
+  return (double(other) + double(green) / 2) / (3.0 * double(superpixels));
+}
+
+// Start of the index-th of count nearly equal pieces of length
+size_t TileEdge(size_t length, size_t index, size_t count)
+{
+  return length * index / count;
+}
+
+cv::Size ClampGrid(cv::Size grid, int columns, int rows)
+{
+  return cv::Size(std::clamp(grid.width, 1, std::max(1, columns)), std::clamp(grid.height, 1, std::max(1, rows)));
+}
+
+void TileIntensities(const cv::Mat& frame, cv::Size grid, std::vector<double>& means, unsigned decimation)
+{
+  CV_Assert(frame.depth() == CV_8U);
+  decimation = std::max(1u, decimation);
+  grid = ClampGrid(grid, frame.cols, frame.rows);
+
+  const size_t tiles = size_t(grid.area());
+  means.assign(tiles, 0);
+  if (frame.empty())
+    return;
+
+  const size_t channels = frame.channels();
+  std::vector<uint64_t> sums(tiles, 0);
+  std::vector<size_t> samples(tiles, 0);
+  for (int row = 0; row < frame.rows; row += decimation)
+  {
+    const uint8_t* data = frame.ptr<uint8_t>(row);
+    const size_t tileRow = size_t(row) * grid.height / frame.rows;
+    for (int column = 0; column < grid.width; ++column)
+    {
+      const size_t begin = TileEdge(frame.cols, column, grid.width) * channels;
+      const size_t end = TileEdge(frame.cols, column + 1, grid.width) * channels;
+      sums[tileRow * grid.width + column] += SumBytes(data + begin, end - begin);
+      samples[tileRow * grid.width + column] += end - begin;
+    }
+  }
+
+  for (size_t i = 0; i < tiles; ++i)
+    if (samples[i] != 0)
+      means[i] = double(sums[i]) / double(samples[i]);
+}
+
+void TileBayerIntensities(const cv::Mat& mosaic, bool greenOnDiagonal, cv::Size grid, std::vector<double>& means, unsigned decimation)
+{
+  CV_Assert(mosaic.depth() == CV_8U && mosaic.channels() == 1);
+  decimation = std::max(1u, decimation);
+
+  // Tiles are laid out in superpixels, so every span starts on an even byte
+  const int superColumns = mosaic.cols / 2;
+  const int superRows = mosaic.rows / 2;
+  grid = ClampGrid(grid, superColumns, superRows);
+
+  const size_t tiles = size_t(grid.area());
+  means.assign(tiles, 0);
+  if (superColumns == 0 || superRows == 0)
+    return;
+
+  std::vector<uint64_t> green(tiles, 0);
+  std::vector<uint64_t> other(tiles, 0);
+  std::vector<size_t> superpixels(tiles, 0);
+  for (int superRow = 0; superRow < superRows; superRow += decimation)
+  {
+    const uint8_t* top = mosaic.ptr<uint8_t>(2 * superRow);
+    const uint8_t* bottom = mosaic.ptr<uint8_t>(2 * superRow + 1);
+    const size_t tileRow = size_t(superRow) * grid.height / superRows;
+    for (int column = 0; column < grid.width; ++column)
+    {
+      const size_t begin = TileEdge(superColumns, column, grid.width);
+      const size_t end = TileEdge(superColumns, column + 1, grid.width);
+      const size_t tile = tileRow * grid.width + column;
+
+      uint64_t evenTop, oddTop, evenBottom, oddBottom;
+      SumBytesInterleaved(top + 2 * begin, 2 * (end - begin), evenTop, oddTop);
+      SumBytesInterleaved(bottom + 2 * begin, 2 * (end - begin), evenBottom, oddBottom);
+      if (greenOnDiagonal)
+      {
+        green[tile] += evenTop + oddBottom;
+        other[tile] += oddTop + evenBottom;
+      }
+      else
+      {
+        green[tile] += oddTop + evenBottom;
+        other[tile] += evenTop + oddBottom;
+      }
+      superpixels[tile] += end - begin;
+    }
+  }
+
+  for (size_t i = 0; i < tiles; ++i)
+    if (superpixels[i] != 0)
+      means[i] = (double(other[i]) + double(green[i]) / 2) / (3.0 * double(superpixels[i]));
+}
+
+void TileDifferences(const cv::Mat& previous, const cv::Mat& current, cv::Size grid, std::vector<double>& means)
+{
+  CV_Assert(previous.depth() == CV_8U && previous.type() == current.type() && previous.size() == current.size());
+  grid = ClampGrid(grid, current.cols, current.rows);
+
+  const size_t tiles = size_t(grid.area());
+  means.assign(tiles, 0);
+  if (current.empty())
+    return;
+
+  const size_t channels = current.channels();
+  std::vector<uint64_t> sums(tiles, 0);
+  std::vector<size_t> samples(tiles, 0);
+  for (int row = 0; row < current.rows; ++row)
+  {
+    const uint8_t* a = previous.ptr<uint8_t>(row);
+    const uint8_t* b = current.ptr<uint8_t>(row);
+    const size_t tileRow = size_t(row) * grid.height / current.rows;
+    for (int column = 0; column < grid.width; ++column)
+    {
+      const size_t begin = TileEdge(current.cols, column, grid.width) * channels;
+      const size_t end = TileEdge(current.cols, column + 1, grid.width) * channels;
+      sums[tileRow * grid.width + column] += SumAbsDiff(a + begin, b + begin, end - begin);
+      samples[tileRow * grid.width + column] += end - begin;
+    }
+  }
+
+  for (size_t i = 0; i < tiles; ++i)
+    if (samples[i] != 0)
+      means[i] = double(sums[i]) / double(samples[i]);
+}
\ No newline at end of file
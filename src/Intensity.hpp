@@ -0,0 +1,62 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTENSITY_HPP
+#define INTENSITY_HPP
+
+#include <opencv2/core/mat.hpp>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Sums a run of bytes using the widest SIMD kernel the CPU supports
+uint64_t SumBytes(const uint8_t* data, size_t length);
+
+// Sums the even and odd indexed bytes of a run separately
+void SumBytesInterleaved(const uint8_t* data, size_t length, uint64_t& even, uint64_t& odd);
+
+// Sums |a[i] - b[i]| over two runs of the same length
+uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t length);
+
+// Name of the kernel SumBytes dispatches to ("avx2", "sse2", "neon", "scalar")
+std::string_view IntensityKernelName();
+
+// Mean over every channel of an 8-bit image.  Only every decimation-th row is
+// sampled; rows are summed whole so the kernel always runs on contiguous
+// memory.
+double MeanIntensity(const cv::Mat& frame, unsigned decimation = 1);
+
+// Same measure as MeanIntensity, taken straight from an 8-bit Bayer mosaic
+// without demosaicing.  Each 2x2 superpixel counts as (R + (G1 + G2) / 2 + B) / 3;
+// greenOnDiagonal says whether the top-left site of each superpixel is green
+// (GB/GR layouts) or not (BG/RG).  Decimation skips whole superpixel rows.
+double MeanBayerIntensity(const cv::Mat& mosaic, bool greenOnDiagonal, unsigned decimation = 1);
+
+// MeanIntensity for each tile of a grid laid over the frame, in row-major
+// order.  The frame is still read once, row by row; each row is just summed
+// in grid.width pieces.  The grid is clamped to the frame size.
+void TileIntensities(const cv::Mat& frame, cv::Size grid, std::vector<double>& means, unsigned decimation = 1);
+
+// MeanBayerIntensity for each tile of a grid; tile edges fall on superpixel
+// boundaries
+void TileBayerIntensities(const cv::Mat& mosaic, bool greenOnDiagonal, cv::Size grid, std::vector<double>& means, unsigned decimation = 1);
+
+// Mean absolute difference per byte between two 8-bit images of the same
+// size and type, for each tile of a grid (row-major, clamped to the size)
+void TileDifferences(const cv::Mat& previous, const cv::Mat& current, cv::Size grid, std::vector<double>& means);
+
+#endif
\ No newline at end of file
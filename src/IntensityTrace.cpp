@@ -0,0 +1,103 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "IntensityTrace.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr char TRACE_MAGIC[4] = { 'S', 'W', 'T', 'R' };
+constexpr uint16_t TRACE_VERSION = 1;
+
+void AppendLittleEndian(std::string& out, uint32_t value, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; ++i)
+    out.push_back(char((value >> (8 * i)) & 0xFF));
+}
+
+void AppendFloat(std::string& out, float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  AppendLittleEndian(out, bits, sizeof(bits));
+}
+
+IntensityTrace::IntensityTrace(size_t capacity)
+  : CAPACITY(std::max<size_t>(1, capacity)),
+    columns(0),
+    rows(0),
+    channels(0),
+    flags(CAPACITY),
+    size(0),
+    next(0)
+{
+  Reset(1, 1);
+}
+
+void IntensityTrace::Reset(int columns, int rows)
+{
+  this->columns = columns;
+  this->rows = rows;
+  channels = size_t(columns) * size_t(rows);
+  intensities.assign(CAPACITY * channels, 0);
+  baselines.assign(CAPACITY * channels, 0);
+  size = 0;
+  next = 0;
+}
+
+void IntensityTrace::Push(const std::vector<double>& intensities, const std::vector<double>& baselines, uint8_t flags)
+{
+  for (size_t channel = 0; channel < channels; ++channel)
+  {
+    this->intensities[next * channels + channel] = channel < intensities.size() ? float(intensities[channel]) : 0;
+    this->baselines[next * channels + channel] = channel < baselines.size() ? float(baselines[channel]) : 0;
+  }
+  this->flags[next] = flags;
+  next = (next + 1) % CAPACITY;
+  size = std::min(size + 1, CAPACITY);
+}
+
+std::string IntensityTrace::Serialize(double fps, size_t peakSeekBack) const
+{
+  size_t flagBytes = (size + 3) / 4 * 4;
+  std::string out;
+  out.reserve(20 + flagBytes + size * channels * 2 * sizeof(float));
+
+  out.append(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  AppendLittleEndian(out, TRACE_VERSION, 2);
+  AppendLittleEndian(out, uint32_t(columns), 2);
+  AppendLittleEndian(out, uint32_t(rows), 2);
+  AppendLittleEndian(out, 0, 2);
+  AppendLittleEndian(out, uint32_t(size), 4);
+  AppendFloat(out, float(fps));
+
+  // Oldest first
+  size_t first = (next + CAPACITY - size) % CAPACITY;
+  size_t peak = peakSeekBack != 0 && peakSeekBack <= size ? size - peakSeekBack : size;
+  for (size_t i = 0; i < size; ++i)
+    out.push_back(char(flags[(first + i) % CAPACITY] | (i == peak ? TRACE_PEAK : 0)));
+  out.append(flagBytes - size, '\0');
+
+  for (const auto* column : { &intensities, &baselines })
+    for (size_t i = 0; i < size; ++i)
+    {
+      size_t frame = (first + i) % CAPACITY;
+      for (size_t channel = 0; channel < channels; ++channel)
+        AppendFloat(out, (*column)[frame * channels + channel]);
+    }
+  return out;
+}
\ No newline at end of file
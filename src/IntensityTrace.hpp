@@ -0,0 +1,75 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTENSITYTRACE_HPP
+#define INTENSITYTRACE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Set in a frame's flags when the trigger was watching for a spike (its
+// window was full and no capture was pending), when the frame was a spike,
+// when it ended the clip, and on the clip's brightest frame
+constexpr uint8_t TRACE_ARMED   = 1 << 0;
+constexpr uint8_t TRACE_SPIKE   = 1 << 1;
+constexpr uint8_t TRACE_CAPTURE = 1 << 2;
+constexpr uint8_t TRACE_PEAK    = 1 << 3;
+
+// What the trigger saw over the last few seconds: every tile's brightness
+// and the rolling baseline it was compared against, frame by frame.  Saved
+// next to each clip as a sidecar, so a strike can be charted (or a threshold
+// tried out) without decoding any video.
+//
+// The sidecar is little-endian:
+//   char[4]  "SWTR"
+//   uint16   version (1)
+//   uint16   tile columns
+//   uint16   tile rows
+//   uint16   reserved (0)
+//   uint32   frames
+//   float32  frames per second
+//   uint8    flags[frames], zero padded to a multiple of four
+//   float32  intensity[frames][rows * columns]
+//   float32  baseline[frames][rows * columns]
+// The last frame is the one the capture happened on.  Tiles are in row
+// order; baselines are meaningless on frames without TRACE_ARMED set.
+class IntensityTrace
+{
+public:
+  explicit IntensityTrace(size_t capacity);
+
+  // Forgets every frame; the trigger has started over with a new tile layout
+  void Reset(int columns, int rows);
+  void Push(const std::vector<double>& intensities, const std::vector<double>& baselines, uint8_t flags);
+  // Sidecar covering every frame held, marking the one peakSeekBack frames
+  // from the end (as VideoTrigger::GetPeakSeekBack) as the peak
+  std::string Serialize(double fps, size_t peakSeekBack) const;
+private:
+  const size_t CAPACITY;
+  int columns;
+  int rows;
+  size_t channels;
+  // Rings of CAPACITY frames; next is where the following frame goes
+  std::vector<float> intensities;
+  std::vector<float> baselines;
+  std::vector<uint8_t> flags;
+  size_t size;
+  size_t next;
+};
+
+#endif
\ No newline at end of file
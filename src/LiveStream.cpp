@@ -0,0 +1,108 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "LiveStream.hpp"
+
+#include <algorithm>
+#include <map>
+#include <spdlog/spdlog.h>
+
+// A write that has not finished in this long belongs to a client that has
+// gone away without the connection noticing
+constexpr std::chrono::seconds STALL_TIMEOUT(30);
+
+LiveStream::LiveStream(double fps)
+  : INTERVAL(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / std::max(0.1, fps)))),
+    running(true),
+    thread(&LiveStream::Run, this)
+{
+}
+
+LiveStream::~LiveStream()
+{
+  running = false;
+  thread.join();
+}
+
+void LiveStream::Subscribe(Camera& camera, Sink sink)
+{
+  auto subscriber = std::make_shared<Subscriber>();
+  subscriber->camera = &camera;
+  subscriber->sink = std::move(sink);
+
+  std::unique_lock lock(subscribersMutex);
+  subscribers.push_back(std::move(subscriber));
+  spdlog::get("web")->info("Live stream of camera {} opened ({} streaming)", camera.GetName(), subscribers.size());
+}
+
+size_t LiveStream::GetSubscriberCount()
+{
+  std::unique_lock lock(subscribersMutex);
+  return subscribers.size();
+}
+
+void LiveStream::Run()
+{
+  std::vector<std::shared_ptr<Subscriber>> ready;
+  std::map<Camera*, PreviewImage> images;
+
+  while (running)
+  {
+    auto now = std::chrono::steady_clock::now();
+    {
+      std::unique_lock lock(subscribersMutex);
+      subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [&](const auto& subscriber)
+      {
+        bool stalled = subscriber->busy && now - subscriber->sentAt > STALL_TIMEOUT;
+        if (subscriber->closed || stalled)
+        {
+          spdlog::get("web")->info("Live stream of camera {} closed{}", subscriber->camera->GetName(), stalled ? " (stalled)" : "");
+          return true;
+        }
+        return false;
+      }), subscribers.end());
+
+      for (const auto& subscriber : subscribers)
+        if (!subscriber->busy)
+          ready.push_back(subscriber);
+    }
+
+    // Sinks only queue the write, so they're cheap to call outside the lock
+    for (const auto& subscriber : ready)
+    {
+      auto image = images.find(subscriber->camera);
+      if (image == images.end())
+        image = images.emplace(subscriber->camera, subscriber->camera->GetPreview()).first;
+      if (image->second.generation == subscriber->generation)
+        continue;
+
+      subscriber->generation = image->second.generation;
+      subscriber->sentAt = now;
+      subscriber->busy = true;
+      subscriber->sink(image->second, [subscriber](bool ok)
+      {
+        if (!ok)
+          subscriber->closed = true;
+        subscriber->busy = false;
+      });
+    }
+    ready.clear();
+    images.clear();
+
+    std::this_thread::sleep_until(now + INTERVAL);
+  }
+}
\ No newline at end of file
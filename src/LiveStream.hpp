@@ -0,0 +1,70 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVESTREAM_HPP
+#define LIVESTREAM_HPP
+
+#include "Camera.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pushes each camera's preview to every client streaming it.  A frame is
+// fetched once per camera per tick and the same buffer is handed to every
+// subscriber; a subscriber whose last frame is still being written simply
+// misses this one, so a slow client never queues more than one frame.
+class LiveStream
+{
+public:
+  using Completion = std::function<void(bool ok)>;
+  // Writes one frame to the client and calls the completion when the write
+  // finishes (or fails, which unsubscribes)
+  using Sink = std::function<void(const PreviewImage& image, Completion done)>;
+
+  explicit LiveStream(double fps);
+  ~LiveStream();
+
+  void Subscribe(Camera& camera, Sink sink);
+  size_t GetSubscriberCount();
+private:
+  struct Subscriber
+  {
+    Camera* camera;
+    Sink sink;
+    // Anything but the first real generation, so the first tick always sends
+    uint64_t generation = UINT64_MAX;
+    std::chrono::steady_clock::time_point sentAt;
+    std::atomic_bool busy = false;
+    std::atomic_bool closed = false;
+  };
+
+  void Run();
+
+  const std::chrono::steady_clock::duration INTERVAL;
+
+  std::mutex subscribersMutex;
+  std::vector<std::shared_ptr<Subscriber>> subscribers;
+  std::atomic_bool running;
+  std::thread thread;
+};
+
+#endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <shlobj.h>
 #else
 #include <xdg.h>
+#include <sys/mman.h>
 #endif
 
 namespace fs = std::filesystem;
@@ -39,4 +40,63 @@ fs::path GetConfigPath()
   path = xdg::config().home();
 #endif
   return path / "stormwatch";
+}
+
+#ifndef WINDOWS
+// MAP_HUGETLB mappings must be a multiple of the huge page size, so every
+// slab is rounded up to 2MB; munmap needs the same length back
+static size_t SlabLength(size_t bytes)
+{
+  const size_t HUGE_PAGE = 2 * 1024 * 1024;
+  return ((bytes + HUGE_PAGE - 1) / HUGE_PAGE) * HUGE_PAGE;
+}
+#endif
+
+void* AllocateSlab(size_t bytes, bool hugePages)
+{
+  // Both paths hand back lazily committed, kernel zeroed pages, so nothing is
+  // touched until a frame is actually written into it
+#ifdef WINDOWS
+  void* slab = nullptr;
+  if (hugePages)
+  {
+    SIZE_T largePage = GetLargePageMinimum();
+    if (largePage != 0)
+      slab = VirtualAlloc(NULL, ((bytes + largePage - 1) / largePage) * largePage, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+  }
+  if (slab == nullptr)
+    slab = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  return slab;
+#else
+  size_t length = SlabLength(bytes);
+  void* slab = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (hugePages)
+    slab = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (slab == MAP_FAILED)
+  {
+    slab = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED)
+      return nullptr;
+#ifdef MADV_HUGEPAGE
+    // No reserved huge pages; ask for transparent ones instead
+    if (hugePages)
+      madvise(slab, length, MADV_HUGEPAGE);
+#endif
+  }
+  return slab;
+#endif
+}
+
+void FreeSlab(void* slab, size_t bytes)
+{
+  if (slab == nullptr)
+    return;
+#ifdef WINDOWS
+  (void)bytes;
+  VirtualFree(slab, 0, MEM_RELEASE);
+#else
+  munmap(slab, SlabLength(bytes));
+#endif
 }
\ No newline at end of file
@@ -6,4 +6,7 @@
 std::filesystem::path GetDataPath();
 std::filesystem::path GetConfigPath();
 
+void* AllocateSlab(size_t bytes, bool hugePages);
+void FreeSlab(void* slab, size_t bytes);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "RetentionManager.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+// Checked this often even with nothing landing, for the age limit and for
+// other programs filling the disk
+constexpr std::chrono::seconds CHECK_INTERVAL(60);
+constexpr size_t EVICTIONS_PER_PASS = 32;
+
+RetentionManager::RetentionManager(RetentionPolicy policy, const ClipIndex& index, fs::path libraryPath, Evict evict)
+  : POLICY(policy),
+    LIBRARY_PATH(libraryPath),
+    index(index),
+    evict(std::move(evict)),
+    evicted(0),
+    notified(true),
+    stopping(false),
+    thread(&RetentionManager::Run, this)
+{
+}
+
+RetentionManager::~RetentionManager()
+{
+  {
+    std::unique_lock lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void RetentionManager::Notify()
+{
+  {
+    std::unique_lock lock(mutex);
+    notified = true;
+  }
+  wake.notify_one();
+}
+
+LibraryStatus RetentionManager::GetStatus() const
+{
+  auto usage = index.GetUsage();
+  std::error_code error;
+  auto space = fs::space(LIBRARY_PATH, error);
+
+  LibraryStatus status;
+  status.clips = usage.clips;
+  status.bytes = usage.bytes;
+  status.diskKnown = !error;
+  status.diskFreeBytes = error ? 0 : space.available;
+  bool reserving = POLICY.reserveBytes != 0 && status.diskKnown;
+  status.limited = reserving || POLICY.maxBytes != 0;
+  status.quotaBytes = POLICY.maxBytes;
+  if (reserving)
+  {
+    // Everything the clips hold now plus what's free, less the reserve
+    uint64_t disk = status.bytes + status.diskFreeBytes;
+    uint64_t diskQuota = disk - std::min(disk, POLICY.reserveBytes);
+    status.quotaBytes = POLICY.maxBytes != 0 ? std::min(POLICY.maxBytes, diskQuota) : diskQuota;
+  }
+  status.headroomBytes = status.quotaBytes - std::min(status.quotaBytes, status.bytes);
+  status.evicted = evicted;
+  return status;
+}
+
+void RetentionManager::Run()
+{
+  std::unique_lock lock(mutex);
+  while (!stopping)
+  {
+    if (!wake.wait_for(lock, CHECK_INTERVAL, [this] { return stopping || notified; }) || notified)
+    {
+      notified = false;
+      lock.unlock();
+      bool more = Enforce();
+      lock.lock();
+      // A full pass means there's more; go again without waiting
+      notified = notified || more;
+    }
+  }
+}
+
+bool RetentionManager::Enforce()
+{
+  auto cutoff = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    (std::chrono::system_clock::now() - POLICY.maxAge).time_since_epoch()).count();
+  auto status = GetStatus();
+
+  for (size_t i = 0; i < EVICTIONS_PER_PASS; ++i)
+  {
+    bool overQuota = status.limited && status.bytes > status.quotaBytes;
+    auto oldest = index.GetOldestUnprotected();
+    if (!oldest)
+    {
+      if (overQuota)
+        spdlog::get("library")->warn("Library is {} MB over quota and every clip is protected", (status.bytes - status.quotaBytes) / 1024 / 1024);
+      return false;
+    }
+    bool tooOld = POLICY.maxAge.count() != 0 && oldest->id.GetTime() < cutoff;
+    if (!tooOld && !overQuota)
+      return false;
+
+    spdlog::get("library")->info("Evicting clip {} ({})", oldest->id.GetID(), tooOld ? "past age limit" : "over quota");
+    evict(oldest->id);
+    ++evicted;
+    // The ledger already knows what went; the disk gets it back too
+    status.bytes -= std::min(status.bytes, oldest->bytes);
+  }
+  return true;
+}
\ No newline at end of file
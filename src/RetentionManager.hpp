@@ -0,0 +1,93 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RETENTIONMANAGER_HPP
+#define RETENTIONMANAGER_HPP
+
+#include "ClipIndex.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct RetentionPolicy
+{
+  // Most space clips may take; 0 for no limit other than the disk
+  uint64_t maxBytes = 0;
+  // Oldest a clip may get; 0 to keep clips forever
+  std::chrono::hours maxAge{ 0 };
+  // Free space to leave on the disk, so encodes in flight can finish; 0 to
+  // never evict for the disk's sake
+  uint64_t reserveBytes = 0;
+};
+
+struct LibraryStatus
+{
+  size_t clips = 0;
+  uint64_t bytes = 0;
+  // Space clips may take right now: the quota, or less if the disk is short
+  uint64_t quotaBytes = 0;
+  uint64_t headroomBytes = 0;
+  uint64_t diskFreeBytes = 0;
+  size_t evicted = 0;
+  // Whether the free space could be read, and whether there's any limit on
+  // size at all (none without a quota, unless a reserve is set and the free
+  // space can be read)
+  bool diskKnown = false;
+  bool limited = false;
+};
+
+// Deletes the oldest unprotected clips whenever the library is over its
+// quota or holds clips past their age limit.  Sizes come from the index's
+// running total, so keeping to the quota never needs a directory scan; a
+// pass evicts a bounded number of clips before letting anything else at
+// the index.
+class RetentionManager
+{
+public:
+  using Evict = std::function<void(const VideoID&)>;
+
+  RetentionManager(RetentionPolicy policy, const ClipIndex& index, std::filesystem::path libraryPath, Evict evict);
+  ~RetentionManager();
+
+  // Have a look now rather than at the next interval; call after a clip
+  // lands
+  void Notify();
+  LibraryStatus GetStatus() const;
+private:
+  void Run();
+  // True if there may be more to evict
+  bool Enforce();
+
+  const RetentionPolicy POLICY;
+  const std::filesystem::path LIBRARY_PATH;
+  const ClipIndex& index;
+  const Evict evict;
+
+  std::atomic<size_t> evicted;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool notified;
+  bool stopping;
+  std::thread thread;
+};
+
+#endif
\ No newline at end of file
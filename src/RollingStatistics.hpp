@@ -0,0 +1,157 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROLLINGSTATISTICS_HPP
+#define ROLLINGSTATISTICS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Windowed mean, variance, minimum and maximum over the last `window`
+// samples, all O(1) (amortized) per Push.  Sums are kept running; min and max
+// come from monotonic deques.  Until the window fills, statistics cover only
+// the samples seen so far.
+template<typename T>
+class RollingStatistics
+{
+public:
+  explicit RollingStatistics(size_t window)
+  : values(std::max<size_t>(1, window)),
+    position(0),
+    count(0),
+    pushed(0),
+    sum(0),
+    sumOfSquares(0) { }
+
+  void Push(T value)
+  {
+    if (count == values.size())
+    {
+      const Accumulator oldest = values[position];
+      sum -= oldest;
+      sumOfSquares -= oldest * oldest;
+    }
+    else
+      ++count;
+
+    values[position] = value;
+    sum += Accumulator(value);
+    sumOfSquares += Accumulator(value) * Accumulator(value);
+    position = (position + 1) % values.size();
+
+    // Floating point sums drift as samples come and go; resum once per lap
+    if constexpr (std::is_floating_point_v<Accumulator>)
+      if (position == 0)
+        Resum();
+
+    while (!maxima.empty() && maxima.back().second <= value)
+      maxima.pop_back();
+    maxima.emplace_back(pushed, value);
+    while (!minima.empty() && minima.back().second >= value)
+      minima.pop_back();
+    minima.emplace_back(pushed, value);
+    ++pushed;
+
+    while (maxima.front().first + values.size() < pushed)
+      maxima.pop_front();
+    while (minima.front().first + values.size() < pushed)
+      minima.pop_front();
+  }
+
+  void Clear()
+  {
+    position = 0;
+    count = 0;
+    pushed = 0;
+    sum = 0;
+    sumOfSquares = 0;
+    maxima.clear();
+    minima.clear();
+  }
+
+  size_t Count() const
+  {
+    return count;
+  }
+
+  size_t Window() const
+  {
+    return values.size();
+  }
+
+  bool Full() const
+  {
+    return count == values.size();
+  }
+
+  double Mean() const
+  {
+    return count == 0 ? 0.0 : double(sum) / count;
+  }
+
+  double Variance() const
+  {
+    if (count == 0)
+      return 0.0;
+    double mean = Mean();
+    return std::max(0.0, double(sumOfSquares) / count - mean * mean);
+  }
+
+  double StandardDeviation() const
+  {
+    return std::sqrt(Variance());
+  }
+
+  T Min() const
+  {
+    return minima.empty() ? T() : minima.front().second;
+  }
+
+  T Max() const
+  {
+    return maxima.empty() ? T() : maxima.front().second;
+  }
+private:
+  using Accumulator = std::conditional_t<std::is_integral_v<T>, int64_t, double>;
+
+  void Resum()
+  {
+    sum = 0;
+    sumOfSquares = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      sum += Accumulator(values[i]);
+      sumOfSquares += Accumulator(values[i]) * Accumulator(values[i]);
+    }
+  }
+
+  std::vector<T> values;
+  size_t position;
+  size_t count;
+  uint64_t pushed;
+  Accumulator sum;
+  Accumulator sumOfSquares;
+  std::deque<std::pair<uint64_t, T>> maxima;
+  std::deque<std::pair<uint64_t, T>> minima;
+};
+
+#endif
\ No newline at end of file
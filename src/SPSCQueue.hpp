@@ -0,0 +1,154 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Bounded, lock-free queue between exactly one producer thread and one
+// consumer thread.  The producer never blocks: a push into a full queue fails
+// (and is counted as an overflow).  The consumer either polls with TryPop()
+// or sleeps in WaitPop() until something arrives; pushes only touch the lock
+// while the consumer is actually asleep.
+template<typename T>
+class SPSCQueue
+{
+public:
+  explicit SPSCQueue(size_t capacity)
+  : capacity(RoundUp(capacity)),
+    mask(this->capacity - 1),
+    slots(this->capacity),
+    head(0),
+    tailCache(0),
+    tail(0),
+    headCache(0),
+    overflows(0),
+    sleeping(false) { }
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  // Producer side
+  bool TryPush(T value)
+  {
+    const size_t position = tail.load(std::memory_order_relaxed);
+    if (position - headCache == capacity)
+    {
+      headCache = head.load(std::memory_order_acquire);
+      if (position - headCache == capacity)
+      {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    slots[position & mask] = std::move(value);
+    tail.store(position + 1, std::memory_order_release);
+
+    // Pairs with the fence in WaitPop(): either the consumer sees the new
+    // tail before it sleeps, or this sees it sleeping and wakes it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+    {
+      std::lock_guard lock(wakeMutex);
+      wake.notify_one();
+    }
+    return true;
+  }
+
+  // Consumer side
+  bool TryPop(T& value)
+  {
+    const size_t position = head.load(std::memory_order_relaxed);
+    if (position == tailCache)
+    {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (position == tailCache)
+        return false;
+    }
+    value = std::move(slots[position & mask]);
+    slots[position & mask] = T();
+    head.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; gives up after timeout so the caller can check whether
+  // it should still be running
+  bool WaitPop(T& value, std::chrono::milliseconds timeout)
+  {
+    if (TryPop(value))
+      return true;
+
+    std::unique_lock lock(wakeMutex);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool popped = wake.wait_for(lock, timeout, [&]() { return TryPop(value); });
+    sleeping.store(false, std::memory_order_relaxed);
+    return popped;
+  }
+
+  // Safe from any thread; a snapshot that may be stale by the time it returns
+  size_t Depth() const
+  {
+    const size_t consumed = head.load(std::memory_order_acquire);
+    return tail.load(std::memory_order_acquire) - consumed;
+  }
+
+  size_t Capacity() const
+  {
+    return capacity;
+  }
+
+  size_t Overflows() const
+  {
+    return overflows.load(std::memory_order_relaxed);
+  }
+private:
+  static size_t RoundUp(size_t value)
+  {
+    size_t rounded = 1;
+    while (rounded < value)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  const size_t capacity;
+  const size_t mask;
+  std::vector<T> slots;
+
+  // Consumer owned
+  alignas(64) std::atomic<size_t> head;
+  size_t tailCache;
+
+  // Producer owned
+  alignas(64) std::atomic<size_t> tail;
+  size_t headCache;
+
+  alignas(64) std::atomic<size_t> overflows;
+
+  // Only used once the consumer has nothing left to pop
+  alignas(64) std::atomic<bool> sleeping;
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+};
+
+#endif
\ No newline at end of file
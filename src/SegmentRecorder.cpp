@@ -0,0 +1,212 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SegmentRecorder.hpp"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <ffmpegcpp/ffmpegcpp.h>
+#include <algorithm>
+
+#include "FFmpegUtils.hpp"
+
+namespace fs = std::filesystem;
+
+RecordedSegment::RecordedSegment(fs::path path, size_t frames)
+  : path(path),
+    frames(frames)
+{
+}
+
+RecordedSegment::~RecordedSegment()
+{
+  std::error_code error;
+  fs::remove(path, error);
+}
+
+class SegmentRecorder::Writer
+{
+public:
+  Writer(const fs::path& path, cv::Size dimensions, AVRational fps, EncoderProfile profile, size_t concurrency)
+  {
+    muxer = std::make_unique<ffmpegcpp::Muxer>(path.string());
+    codec = MakeCodec(profile, dimensions, fps, concurrency);
+    encoder = std::make_unique<ffmpegcpp::VideoEncoder>(codec.get(), muxer.get(), fps, AV_PIX_FMT_YUV420P);
+    source = std::make_unique<ffmpegcpp::RawVideoDataSource>(dimensions.width, dimensions.height, AV_PIX_FMT_BGR24, fps, encoder.get());
+  }
+
+  void Write(const cv::Mat& frame)
+  {
+    source->WriteFrame(frame.data, int(frame.step[0]));
+  }
+
+  void Close()
+  {
+    source->Close();
+  }
+private:
+  std::unique_ptr<ffmpegcpp::Muxer> muxer;
+  std::unique_ptr<ffmpegcpp::VideoCodec> codec;
+  std::unique_ptr<ffmpegcpp::VideoEncoder> encoder;
+  std::unique_ptr<ffmpegcpp::RawVideoDataSource> source;
+};
+
+SegmentRecorder::SegmentRecorder(fs::path directory, cv::Size dimensions, double fps, double segmentSeconds, double windowSeconds, EncoderProfile profile, size_t concurrency)
+  : directory(directory),
+    dimensions(dimensions),
+    fps(fps),
+    profile(profile),
+    concurrency(concurrency),
+    SEGMENT_FRAMES(std::max<size_t>(1, segmentSeconds * fps)),
+    WINDOW_FRAMES(std::max<size_t>(1, windowSeconds * fps)),
+    QUEUE_LIMIT(GetQueueLimit(fps)),
+    stopping(false),
+    dropped(0),
+    currentFrames(0),
+    segmentCounter(0),
+    windowFrames(0)
+{
+  // Leftovers from a previous run are useless; no one can reference them
+  if (fs::exists(directory))
+    fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  thread = std::thread(&SegmentRecorder::Run, this);
+}
+
+SegmentRecorder::~SegmentRecorder()
+{
+  {
+    std::unique_lock lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void SegmentRecorder::Push(std::shared_ptr<ClipFrames> frame)
+{
+  {
+    std::unique_lock lock(mutex);
+    if (queue.size() >= QUEUE_LIMIT)
+    {
+      // Never hold up capture; the segment just comes out a little short
+      if (dropped++ % QUEUE_LIMIT == 0)
+        spdlog::get("library")->warn("Segment encoder is falling behind; {} frames dropped", dropped);
+      return;
+    }
+    queue.push_back(Work { frame, nullptr });
+  }
+  wake.notify_one();
+}
+
+std::shared_future<SegmentList> SegmentRecorder::Cut()
+{
+  auto promise = std::make_shared<std::promise<SegmentList>>();
+  std::shared_future<SegmentList> segments = promise->get_future().share();
+  {
+    std::unique_lock lock(mutex);
+    queue.push_back(Work { nullptr, promise });
+  }
+  wake.notify_one();
+  return segments;
+}
+
+size_t SegmentRecorder::GetQueueLimit(double fps)
+{
+  // Two seconds of video
+  return std::max<size_t>(1, 2 * fps);
+}
+
+void SegmentRecorder::Run()
+{
+  while (true)
+  {
+    Work work;
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (queue.empty())
+        break;
+      work = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    try
+    {
+      if (work.frame)
+      {
+        Write(*work.frame);
+        if (currentFrames >= SEGMENT_FRAMES)
+          CloseSegment();
+      }
+      else if (work.cut)
+      {
+        CloseSegment();
+        work.cut->set_value(SegmentList(window.cbegin(), window.cend()));
+      }
+    }
+    catch (ffmpegcpp::FFmpegException& e)
+    {
+      spdlog::get("library")->error("Segment encoding failed: {}", e.what());
+      // The half written segment never makes it into the window, so nothing
+      // else would ever delete it
+      writer.reset();
+      std::error_code error;
+      fs::remove(currentPath, error);
+      currentPath.clear();
+      currentFrames = 0;
+      if (work.cut)
+        work.cut->set_value(SegmentList(window.cbegin(), window.cend()));
+    }
+  }
+
+  CloseSegment();
+}
+
+void SegmentRecorder::Write(ClipFrames& frame)
+{
+  if (!writer)
+  {
+    currentPath = directory / fmt::format("{}.webm", segmentCounter++);
+    writer = std::make_unique<Writer>(currentPath, dimensions, NearestRational(fps), profile, concurrency);
+    currentFrames = 0;
+  }
+
+  cv::Mat scratch;
+  writer->Write(frame.Get(0, scratch));
+  ++currentFrames;
+}
+
+void SegmentRecorder::CloseSegment()
+{
+  if (!writer)
+    return;
+
+  writer->Close();
+  writer.reset();
+  window.push_back(std::make_shared<const RecordedSegment>(currentPath, currentFrames));
+  windowFrames += currentFrames;
+  currentFrames = 0;
+
+  // Keep just enough segments to cover the clip length
+  while (window.size() > 1 && windowFrames - window.front()->frames >= WINDOW_FRAMES)
+  {
+    windowFrames -= window.front()->frames;
+    window.pop_front();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEGMENTRECORDER_HPP
+#define SEGMENTRECORDER_HPP
+
+#include "ClipFrames.hpp"
+#include "EncoderProfile.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A short, self contained webm file starting on a keyframe.  The file is
+// removed once the last reference to the segment goes away.
+struct RecordedSegment
+{
+  RecordedSegment(std::filesystem::path path, size_t frames);
+  ~RecordedSegment();
+
+  const std::filesystem::path path;
+  const size_t frames;
+};
+
+using SegmentList = std::vector<std::shared_ptr<const RecordedSegment>>;
+
+// Continuously encodes frames into short segments on its own thread, keeping
+// a rolling window of them on disk.  A trigger only has to Cut() the current
+// segment and stitch the window together, instead of encoding the whole clip
+// after the fact.
+class SegmentRecorder
+{
+public:
+  // concurrency is how many other encodes share the machine's cores with
+  // this one, as for MakeCodec()
+  SegmentRecorder(std::filesystem::path directory, cv::Size dimensions, double fps, double segmentSeconds, double windowSeconds, EncoderProfile profile, size_t concurrency);
+  SegmentRecorder(const SegmentRecorder&) = delete;
+  SegmentRecorder& operator=(const SegmentRecorder&) = delete;
+  virtual ~SegmentRecorder();
+
+  void Push(std::shared_ptr<ClipFrames> frame);
+  std::shared_future<SegmentList> Cut();
+
+  // Most frames waiting to be encoded before Push() starts dropping them;
+  // each keeps whatever it was pinned from pinned until then
+  static size_t GetQueueLimit(double fps);
+private:
+  class Writer;
+
+  struct Work
+  {
+    std::shared_ptr<ClipFrames> frame;
+    std::shared_ptr<std::promise<SegmentList>> cut;
+  };
+
+  void Run();
+  void Write(ClipFrames& frame);
+  void CloseSegment();
+
+  const std::filesystem::path directory;
+  const cv::Size dimensions;
+  const double fps;
+  const EncoderProfile profile;
+  const size_t concurrency;
+  const size_t SEGMENT_FRAMES;
+  const size_t WINDOW_FRAMES;
+  const size_t QUEUE_LIMIT;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Work> queue;
+  bool stopping;
+  size_t dropped;
+
+  // Only touched by the encoder thread
+  std::unique_ptr<Writer> writer;
+  std::filesystem::path currentPath;
+  size_t currentFrames;
+  size_t segmentCounter;
+  std::deque<std::shared_ptr<const RecordedSegment>> window;
+  size_t windowFrames;
+
+  std::thread thread;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SegmentStitchJob.hpp"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+SegmentStitchJob::SegmentStitchJob(
+  std::shared_future<SegmentList> segments,
+  std::shared_ptr<ClipFrames> thumbnailFrames,
+  size_t peakSeekBack,
+  std::filesystem::path videoPath,
+  StillPaths stillPaths)
+  : segments(segments), thumbnailFrames(thumbnailFrames),
+    peakSeekBack(peakSeekBack), videoPath(videoPath),
+    stillPaths(stillPaths)
+{}
+
+void SegmentStitchJob::operator()()
+{
+  spdlog::get("library")->info("Started stitch for clip {}", videoPath.string());
+
+  try
+  {
+    StillImages stills = MakeStills(*thumbnailFrames, peakSeekBack);
+    thumbnailFrames.reset();
+
+    const SegmentList& list = segments.get();
+    if (list.empty() || !Stitch(list))
+    {
+      spdlog::get("library")->error("Unable to stitch clip {}", videoPath.string());
+      DiscardClip(videoPath, stillPaths);
+      return;
+    }
+
+    if (WriteStills(stills, stillPaths))
+      spdlog::get("library")->info("Clip saved as {} ({} segments)", videoPath.string(), list.size());
+    else
+      DiscardClip(videoPath, stillPaths);
+  }
+  catch (...)
+  {
+    DiscardClip(videoPath, stillPaths);
+    throw;
+  }
+}
+
+bool SegmentStitchJob::Stitch(const SegmentList& list)
+{
+  AVFormatContext* output = nullptr;
+  if (avformat_alloc_output_context2(&output, nullptr, "webm", videoPath.string().c_str()) < 0)
+    return false;
+
+  AVStream* outputStream = nullptr;
+  int64_t offset = 0;
+  bool headerWritten = false;
+  bool success = true;
+
+  for (const auto& segment : list)
+  {
+    AVFormatContext* input = nullptr;
+    if (avformat_open_input(&input, segment->path.string().c_str(), nullptr, nullptr) < 0)
+    {
+      spdlog::get("library")->warn("Skipping unreadable segment {}", segment->path.string());
+      continue;
+    }
+    if (avformat_find_stream_info(input, nullptr) < 0 || input->nb_streams == 0)
+    {
+      avformat_close_input(&input);
+      continue;
+    }
+    AVStream* inputStream = input->streams[0];
+
+    if (outputStream == nullptr)
+    {
+      outputStream = avformat_new_stream(output, nullptr);
+      avcodec_parameters_copy(outputStream->codecpar, inputStream->codecpar);
+      outputStream->codecpar->codec_tag = 0;
+      outputStream->time_base = inputStream->time_base;
+      if (avio_open(&output->pb, videoPath.string().c_str(), AVIO_FLAG_WRITE) < 0 ||
+          avformat_write_header(output, nullptr) < 0)
+      {
+        avformat_close_input(&input);
+        success = false;
+        break;
+      }
+      headerWritten = true;
+    }
+
+    // Every segment starts at zero; shift it to follow on from the last one
+    int64_t end = offset;
+    AVPacket packet;
+    av_init_packet(&packet);
+    while (av_read_frame(input, &packet) >= 0)
+    {
+      if (packet.stream_index == 0)
+      {
+        av_packet_rescale_ts(&packet, inputStream->time_base, outputStream->time_base);
+        if (packet.pts != AV_NOPTS_VALUE)
+        {
+          packet.pts += offset;
+          end = std::max(end, packet.pts + std::max<int64_t>(packet.duration, 1));
+        }
+        if (packet.dts != AV_NOPTS_VALUE)
+          packet.dts += offset;
+        packet.pos = -1;
+        if (av_interleaved_write_frame(output, &packet) < 0)
+          success = false;
+      }
+      av_packet_unref(&packet);
+    }
+    offset = end;
+    avformat_close_input(&input);
+  }
+
+  if (headerWritten)
+    av_write_trailer(output);
+  else
+    success = false;
+  if (output->pb != nullptr)
+    avio_closep(&output->pb);
+  avformat_free_context(output);
+  return success;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEGMENTSTITCHJOB_HPP
+#define SEGMENTSTITCHJOB_HPP
+
+#include "ClipFrames.hpp"
+#include "ClipStills.hpp"
+#include "SegmentRecorder.hpp"
+
+#include <future>
+#include <filesystem>
+
+// Remuxes a run of pre-encoded segments into a single clip; no decoding or
+// encoding happens here
+class SegmentStitchJob
+{
+public:
+  SegmentStitchJob(
+    std::shared_future<SegmentList> segments,
+    std::shared_ptr<ClipFrames> thumbnailFrames,
+    size_t peakSeekBack,
+    std::filesystem::path videoPath,
+    StillPaths stillPaths);
+
+  void operator()();
+private:
+  bool Stitch(const SegmentList& list);
+
+  std::shared_future<SegmentList> segments;
+  std::shared_ptr<ClipFrames> thumbnailFrames;
+
+  size_t peakSeekBack;
+  std::filesystem::path videoPath;
+  StillPaths stillPaths;
+};
+
+#endif
\ No newline at end of file
@@ -16,17 +16,21 @@
  */
 
 #include "Server.hpp"
+#include "StaticAssets.hpp"
 
 #include <restinio/all.hpp>
-#include <cmrc/cmrc.hpp>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
-
-CMRC_DECLARE(web_resources);
+#include <charconv>
+#include <chrono>
 
 using json = nlohmann::json;
 using router_t = restinio::router::express_router_t<restinio::router::std_regex_engine_t>;
 
+constexpr std::string_view MJPEG_BOUNDARY = "stormwatch-frame";
+constexpr size_t MAX_CLIPS_PER_PAGE = 1000;
+constexpr std::string_view CLIP_CACHE_CONTROL = "public, max-age=86400";
+
 template <typename RESP>
 inline RESP init(RESP resp)
 {
@@ -36,83 +40,382 @@ inline RESP init(RESP resp)
 	return resp;
 }
 
-inline std::string ReadFile(const cmrc::file& file)
+// Answers the request from the worker pool instead of the I/O thread that
+// received it, for handlers that touch the disk or wait on other threads.
+// The handler must send its own response, errors included.
+template <typename Handler>
+inline restinio::request_handling_status_t OffLoop(boost::asio::thread_pool& workers, restinio::request_handle_t req, Handler&& handler)
 {
-  std::string contents;
-  for (const char& i : file)
-    contents += i;
-  return contents;
+  boost::asio::post(workers, [req, handler = std::forward<Handler>(handler)]() mutable
+  {
+    try
+    {
+      handler(req);
+    }
+    catch (const std::exception& e)
+    {
+      spdlog::get("web")->error("error handling {}: {}", req->header().request_target(), e.what());
+      init(req->create_response(restinio::status_internal_server_error()))
+        .connection_close()
+        .done();
+    }
+  });
+  return restinio::request_accepted();
 }
 
-inline void StaticDirectoryMapper(std::unique_ptr<router_t>& router, std::shared_ptr<cmrc::embedded_filesystem> fs, std::string path, std::string mime)
+// True if the request's If-None-Match names etag, so a 304 will do
+inline bool MatchesETag(const restinio::request_handle_t& req, std::string_view etag)
 {
-  router->http_get(
-    fmt::format("/{}/([a-zA-Z0-9\\.:-]+)", path),
-    [fs, path, mime](auto req, auto params)
+  auto header = req->header().opt_value_of(restinio::http_field::if_none_match);
+  if (!header)
+    return false;
+
+  std::string_view tags = *header;
+  while (!tags.empty())
+  {
+    size_t end = std::min(tags.find(','), tags.size());
+    auto tag = tags.substr(0, end);
+    tags.remove_prefix(std::min(end + 1, tags.size()));
+
+    tag.remove_prefix(std::min(tag.find_first_not_of(" \t"), tag.size()));
+    tag = tag.substr(0, std::min(tag.find_last_not_of(" \t") + 1, tag.size()));
+    // Weak comparison is all If-None-Match asks for
+    if (tag.substr(0, 2) == "W/")
+      tag.remove_prefix(2);
+    if (tag == "*" || tag == etag)
+      return true;
+  }
+  return false;
+}
+
+// vary has to match what the full response would have sent, or a cache may
+// hand the wrong representation back out
+inline restinio::request_handling_status_t NotModified(const restinio::request_handle_t& req, const std::string& etag, std::string_view cacheControl, std::string_view vary = {})
+{
+  auto response = init(req->create_response(restinio::status_not_modified()));
+  response
+    .append_header(restinio::http_field::etag, etag)
+    .append_header(restinio::http_field::cache_control, std::string(cacheControl));
+  if (!vary.empty())
+    response.append_header(restinio::http_field::vary, std::string(vary));
+  return std::move(response).done();
+}
+
+struct RangeRequest
+{
+  enum
+  {
+    // No range, or one this server doesn't handle (several at once, say);
+    // the whole file is the right answer either way
+    Whole,
+    Partial,
+    Unsatisfiable
+  } kind = Whole;
+  uint64_t first = 0;
+  uint64_t length = 0;
+};
+
+// A Range header against a file of size bytes, honouring If-Range
+inline RangeRequest ParseRange(const restinio::request_handle_t& req, uint64_t size, std::string_view etag)
+{
+  constexpr std::string_view UNIT = "bytes=";
+  auto header = req->header().opt_value_of(restinio::http_field::range);
+  if (!header || header->substr(0, UNIT.size()) != UNIT || header->find(',') != std::string_view::npos)
+    return {};
+  // A stale If-Range means the client's partial copy is no good
+  if (auto ifRange = req->header().opt_value_of(restinio::http_field::if_range); ifRange && *ifRange != etag)
+    return {};
+
+  auto spec = header->substr(UNIT.size());
+  auto dash = spec.find('-');
+  if (dash == std::string_view::npos)
+    return {};
+  auto parse = [](std::string_view digits, uint64_t& value)
+  {
+    auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    return !digits.empty() && error == std::errc() && end == digits.data() + digits.size();
+  };
+
+  RangeRequest range;
+  uint64_t first, last;
+  if (dash == 0)
+  {
+    // -n is the last n bytes
+    if (!parse(spec.substr(1), last))
+      return {};
+    if (last == 0 || size == 0)
+      range.kind = RangeRequest::Unsatisfiable;
+    else
     {
-      auto requestedFile = fmt::format("{}/{}", path, std::string(params[0]));
-      if (fs->exists(requestedFile))
-      {
-        return init(req->create_response())
-          .append_header(restinio::http_field::content_type, mime)
-          .set_body(ReadFile(fs->open(requestedFile)))
-          .done();
-      }
-      else
-        return restinio::request_rejected();
-    });
+      range.kind = RangeRequest::Partial;
+      range.first = size - std::min(last, size);
+      range.length = size - range.first;
+    }
+    return range;
+  }
+
+  if (!parse(spec.substr(0, dash), first))
+    return {};
+  if (spec.size() == dash + 1)
+    last = UINT64_MAX;
+  else if (!parse(spec.substr(dash + 1), last) || last < first)
+    return {};
+
+  if (first >= size)
+    range.kind = RangeRequest::Unsatisfiable;
+  else
+  {
+    range.kind = RangeRequest::Partial;
+    range.first = first;
+    range.length = std::min(last, size - 1) - first + 1;
+  }
+  return range;
+}
+
+inline restinio::request_handling_status_t ServeAsset(const restinio::request_handle_t& req, const StaticAsset& asset)
+{
+  auto encoding = StaticAssets::Negotiate(asset, req->header().get_field_or(restinio::http_field::accept_encoding, ""));
+  const auto& etag = asset.etags[size_t(encoding)];
+  if (MatchesETag(req, etag))
+    return NotModified(req, etag, asset.cacheControl, "Accept-Encoding");
+
+  auto response = init(req->create_response());
+  response
+    .append_header(restinio::http_field::content_type, std::string(asset.mime))
+    .append_header(restinio::http_field::etag, etag)
+    .append_header(restinio::http_field::cache_control, std::string(asset.cacheControl))
+    .append_header(restinio::http_field::vary, "Accept-Encoding");
+  if (encoding != ContentEncoding::Identity)
+    response.append_header(restinio::http_field::content_encoding, std::string(StaticAssets::GetName(encoding)));
+
+  // The body is embedded in the binary, so it can be sent without a copy
+  const auto& body = asset.bodies[size_t(encoding)];
+  return std::move(response)
+    .set_body(restinio::const_buffer(body.data(), body.size()))
+    .done();
+}
+
+// Sends a file belonging to a clip (the video, a still or the trace);
+// these never change once written, and players seek with ranges
+inline void ServeClipFile(const restinio::request_handle_t& req, const std::optional<std::filesystem::path>& path, std::string_view contentType)
+{
+  std::error_code error;
+  auto size = path ? std::filesystem::file_size(path.value(), error) : 0;
+  auto modified = path ? std::filesystem::last_write_time(path.value(), error) : std::filesystem::file_time_type();
+  if (!path || error)
+  {
+    init(req->create_response(restinio::status_not_found()))
+      .connection_close()
+      .done();
+    return;
+  }
+
+  // Clips are never rewritten under the same ID, so the tag only has
+  // to tell this file from a damaged or replaced one
+  auto etag = fmt::format("\"{:x}-{:x}\"", size, modified.time_since_epoch().count());
+  if (MatchesETag(req, etag))
+  {
+    NotModified(req, etag, CLIP_CACHE_CONTROL);
+    return;
+  }
+
+  // Players seek by asking for the part of the file they need
+  auto range = ParseRange(req, size, etag);
+  if (range.kind == RangeRequest::Unsatisfiable)
+  {
+    init(req->create_response(restinio::http_status_line_t(restinio::http_status_code_t(416), "Range Not Satisfiable")))
+      .append_header(restinio::http_field::content_range, fmt::format("bytes */{}", size))
+      .done();
+    return;
+  }
+
+  auto response = init(range.kind == RangeRequest::Partial ?
+    req->create_response(restinio::status_partial_content()) :
+    req->create_response());
+  response
+    .append_header(restinio::http_field::content_type, std::string(contentType))
+    .append_header(restinio::http_field::accept_ranges, "bytes")
+    .append_header(restinio::http_field::etag, etag)
+    .append_header(restinio::http_field::cache_control, std::string(CLIP_CACHE_CONTROL));
+  if (range.kind == RangeRequest::Partial)
+  {
+    response.append_header(restinio::http_field::content_range, fmt::format("bytes {}-{}/{}", range.first, range.first + range.length - 1, size));
+    std::move(response)
+      .set_body(restinio::sendfile(path.value().string()).offset_and_size(range.first, range.length))
+      .done();
+  }
+  else
+    std::move(response)
+      .set_body(restinio::sendfile(path.value().string()))
+      .done();
 }
 
 inline auto Server::CreateHandler()
 {
   auto router = std::make_unique<router_t>();
-  std::shared_ptr<cmrc::embedded_filesystem> fs = std::make_shared<cmrc::embedded_filesystem>(cmrc::web_resources::get_filesystem());
+  auto assets = std::make_shared<const StaticAssets>();
 
   router->http_get(
-    "/live.jpeg",
+    "/cameras",
     [this](auto req, auto)
     {
+      json list = json::array();
+      for (const auto& camera : cameras)
+        list.push_back(json::object(
+          {
+            { "id", camera->GetName() },
+            { "source", camera->GetSource() },
+            { "enabled", camera->IsRunning() }
+          }));
+
+      return init(req->create_response())
+        .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
+        .set_body(list.dump())
+        .done();
+    });
+
+  router->http_get(
+    "/cameras/(\\d+)/live.jpeg",
+    [this](auto req, auto params)
+    {
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
+      // The dashboard polls this, so let it revalidate cheaply: the tag only
+      // changes when the camera publishes a new preview, or the server restarts
+      PreviewImage image = camera->GetPreview();
+      std::string etag = fmt::format("\"{:x}-{}-{}\"", EPOCH, std::string(params[0]), image.generation);
+      if (image.generation != 0 && MatchesETag(req, etag))
+        return NotModified(req, etag, "no-cache");
+
       return init(req->create_response())
         .append_header(restinio::http_field::content_type, "image/jpeg")
-        .set_body(camera.GetPreview())
+        .append_header(restinio::http_field::etag, etag)
+        .append_header(restinio::http_field::cache_control, "no-cache")
+        .set_body(image.jpeg)
         .done();
     });
   
+  router->http_get(
+    "/cameras/(\\d+)/live.mjpeg",
+    [this](auto req, auto params)
+    {
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
+      // The response stays open; every frame is one part, written by the
+      // stream thread straight from the shared preview buffer
+      auto response = std::make_shared<restinio::response_builder_t<restinio::chunked_output_t>>(
+        init(req->template create_response<restinio::chunked_output_t>())
+          .append_header(restinio::http_field::content_type, fmt::format("multipart/x-mixed-replace; boundary={}", MJPEG_BOUNDARY))
+          .append_header(restinio::http_field::cache_control, "no-cache"));
+      response->flush();
+
+      stream.Subscribe(*camera, [response](const PreviewImage& image, LiveStream::Completion done)
+      {
+        response->append_chunk(fmt::format("--{}\r\nContent-Type: image/jpeg\r\nContent-Length: {}\r\n\r\n", MJPEG_BOUNDARY, image.jpeg->size()));
+        response->append_chunk(image.jpeg);
+        response->append_chunk(std::string("\r\n"));
+        response->flush([done](const auto& error) { done(!error); });
+      });
+      return restinio::request_accepted();
+    });
+
   router->http_post(
-    "/start",
-    [this](auto req, auto)
+    "/cameras/(\\d+)/start",
+    [this](auto req, auto params)
     {
-      camera.Start();
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
 
-      return init(req->create_response())
-        .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
-        .set_body("[]")
-        .done();
+      return OffLoop(workers, req, [camera](auto req)
+      {
+        camera->Start();
+        init(req->create_response())
+          .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
+          .set_body("[]")
+          .done();
+      });
     });
   
   router->http_post(
-    "/stop",
-    [this](auto req, auto)
+    "/cameras/(\\d+)/stop",
+    [this](auto req, auto params)
     {
-      camera.Stop();
-      
-      return init(req->create_response())
-        .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
-        .set_body("[]")
-        .done();
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
+      // Stopping joins the capture thread, which can take a while
+      return OffLoop(workers, req, [camera](auto req)
+      {
+        camera->Stop();
+        init(req->create_response())
+          .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
+          .set_body("[]")
+          .done();
+      });
     });
 
   router->http_get(
-    "/stats",
-    [this](auto req, auto)
+    "/cameras/(\\d+)/stats",
+    [this](auto req, auto params)
     {
-      auto cameraStatus = camera.GetStatus();
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
+      auto cameraStatus = camera->GetStatus();
       json stats;
       stats["width"]       = cameraStatus.resolution.width;
       stats["height"]      = cameraStatus.resolution.height;
       stats["nominalFPS"]  = cameraStatus.nominalFPS;
       stats["measuredFPS"] = cameraStatus.measuredFPS;
-      stats["enabled"]     = camera.IsRunning();
+      stats["enabled"]     = camera->IsRunning();
+      auto queueStats = [](const QueueStatus& queue)
+      {
+        return json::object(
+          {
+            { "depth", queue.depth },
+            { "capacity", queue.capacity },
+            { "overflows", queue.overflows }
+          });
+      };
+      stats["captureQueue"] = queueStats(cameraStatus.captureQueue);
+      stats["previewQueue"] = queueStats(cameraStatus.previewQueue);
+
+      auto libraryStatus = library.GetLibraryStatus();
+      json libraryStats;
+      libraryStats["clips"]    = libraryStatus.clips;
+      libraryStats["bytes"]    = libraryStatus.bytes;
+      libraryStats["quota"]    = libraryStatus.limited ? json(libraryStatus.quotaBytes) : json(nullptr);
+      libraryStats["headroom"] = libraryStatus.limited ? json(libraryStatus.headroomBytes) : json(nullptr);
+      libraryStats["diskFree"] = libraryStatus.diskKnown ? json(libraryStatus.diskFreeBytes) : json(nullptr);
+      libraryStats["evicted"]  = libraryStatus.evicted;
+      stats["library"] = std::move(libraryStats);
+
+      return init(req->create_response())
+        .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
+        .set_body(stats.dump())
+        .done();
+    });
+
+  router->http_get(
+    "/encoder",
+    [this](auto req, auto)
+    {
+      auto encodeStatus = library.GetEncodeStatus();
+      json stats;
+      stats["queued"]        = encodeStatus.queued;
+      stats["running"]       = encodeStatus.running;
+      stats["bytesInFlight"] = encodeStatus.bytesInFlight;
+      stats["spilled"]       = encodeStatus.spilled;
+      stats["dropped"]       = encodeStatus.dropped;
+      stats["merged"]        = encodeStatus.merged;
+      stats["liveStreams"]   = stream.GetSubscriberCount();
 
       return init(req->create_response())
         .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
@@ -124,70 +427,146 @@ inline auto Server::CreateHandler()
     "/clips",
     [this](auto req, auto)
     {
-      json clips;
-      for (const auto& clip : library.GetClips())
+      // Query strings are from, to (timestamps as in the titles), offset,
+      // limit and order (asc or desc, the default)
+      ClipQuery query;
+      try
+      {
+        const auto parameters = restinio::parse_query(req->header().query());
+        if (auto from = parameters.get_param("from"); from)
+          query.from = VideoID::ParseTime(std::string(from.value()));
+        if (auto to = parameters.get_param("to"); to)
+          query.to = VideoID::ParseTime(std::string(to.value()));
+        query.offset = restinio::value_or(parameters, "offset", query.offset);
+        query.limit = std::min(MAX_CLIPS_PER_PAGE, restinio::value_or(parameters, "limit", query.limit));
+        query.newestFirst = restinio::value_or(parameters, "order", std::string("desc")) != "asc";
+      }
+      catch (const std::exception& e)
+      {
+        return init(req->create_response(restinio::status_bad_request()))
+          .append_header(restinio::http_field::content_type, "text/plain; charset=utf-8")
+          .set_body(e.what())
+          .done();
+      }
+
+      // The version is taken before the query, so a change in between can
+      // only cost a refetch, never a stale 304
+      std::string etag = fmt::format("\"{}\"", library.GetClipsVersion());
+      if (MatchesETag(req, etag))
+        return NotModified(req, etag, "no-cache");
+
+      auto page = library.GetClips(query);
+      json clips = json::array();
+      for (const auto& clip : page.clips)
         clips.push_back(json::object(
           {
-            { "title", clip.GetTimestamp() },
-            { "video", fmt::format("/clips/{}.webm", clip.GetID()) },
-            { "thumbnail", fmt::format("/clips/{}.jpeg", clip.GetID()) }
+            { "id", clip.id.GetID() },
+            { "title", clip.id.GetTimestamp() },
+            { "video", fmt::format("/clips/{}.webm", clip.id.GetID()) },
+            { "thumbnail", fmt::format("/clips/{}.jpeg", clip.id.GetID()) },
+            { "preview", fmt::format("/clips/{}.medium.jpeg", clip.id.GetID()) },
+            { "still", fmt::format("/clips/{}.full.jpeg", clip.id.GetID()) },
+            { "trace", fmt::format("/clips/{}/trace", clip.id.GetID()) },
+            { "bytes", clip.bytes },
+            { "protected", clip.isProtected }
           }));
 
+      json result;
+      result["total"]  = page.total;
+      result["offset"] = query.offset;
+      result["clips"]  = std::move(clips);
       return init(req->create_response())
         .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
-        .set_body(clips.dump())
+        .append_header(restinio::http_field::etag, etag)
+        .append_header(restinio::http_field::cache_control, "no-cache")
+        .set_body(result.dump())
         .done();
     });
   
   router->http_get(
-    "/clips/([A-Za-z0-9\\+/=]+)\\.(jpeg|webm)",
+    "/clips/([A-Za-z0-9_\\-\\+/=]+)\\.(jpeg|medium\\.jpeg|full\\.jpeg|webm)",
     [this](auto req, auto params)
     {
-      if (params[1] == "jpeg")
-      {
-        if (auto clipPath = library.GetClipThumbnailPath(VideoID(params[0])); clipPath)
-        {
-          return init(req->create_response())
-            .append_header(restinio::http_field::content_type, "image/jpeg")
-            .set_body(restinio::sendfile(clipPath.value().string()))
-            .done();
-        }
+      auto clip = VideoID::Parse(params[0]);
+      if (!clip)
         return restinio::request_rejected();
-      }
-      else if (params[1] == "webm")
+
+      return OffLoop(workers, req, [this, clip = clip.value(), extension = std::string(params[1])](auto req)
       {
-        if (auto clipPath = library.GetClipVideoPath(VideoID(params[0])); clipPath)
-        {
-          return init(req->create_response())
-            .append_header(restinio::http_field::content_type, "video/webm")
-            .set_body(restinio::sendfile(clipPath.value().string()))
-            .done();
-        }
-        return restinio::request_rejected();
-      }
-      else
+        bool still = extension != "webm";
+        auto clipPath = !still ? library.GetClipVideoPath(clip) :
+          extension == "medium.jpeg" ? library.GetClipStillPath(clip, StillSize::Medium) :
+          extension == "full.jpeg" ? library.GetClipStillPath(clip, StillSize::Full) :
+          library.GetClipStillPath(clip, StillSize::Thumbnail);
+        ServeClipFile(req, clipPath, still ? "image/jpeg" : "video/webm");
+      });
+    });
+
+  router->http_get(
+    "/clips/([A-Za-z0-9_\\-\\+/=]+)/trace",
+    [this](auto req, auto params)
+    {
+      auto clip = VideoID::Parse(params[0]);
+      if (!clip)
         return restinio::request_rejected();
+
+      // The sidecar layout is described in IntensityTrace.hpp
+      return OffLoop(workers, req, [this, clip = clip.value()](auto req)
+      {
+        ServeClipFile(req, library.GetClipTracePath(clip), "application/octet-stream");
+      });
     });
 
   router->http_delete(
-    "/clips/([A-Za-z0-9\\+/=]+)\\.(webm)",
+    "/clips/([A-Za-z0-9_\\-\\+/=]+)\\.(webm)",
     [this](auto req, auto params)
     {
-      auto result = library.DeleteClip(VideoID(params[0]));
+      auto clip = VideoID::Parse(params[0]);
+      if (!clip)
+        return restinio::request_rejected();
 
-      return init(req->create_response())
-        .append_header(restinio::http_field::content_type, "text/plain; charset=utf-8")
-        .set_body(result ? "true" : "false")
-        .done();
+      return OffLoop(workers, req, [this, clip = clip.value()](auto req)
+      {
+        auto result = library.DeleteClip(clip);
+
+        init(req->create_response())
+          .append_header(restinio::http_field::content_type, "text/plain; charset=utf-8")
+          .set_body(result ? "true" : "false")
+          .done();
+      });
+    });
+
+  router->http_post(
+    "/clips/([A-Za-z0-9_\\-\\+/=]+)/(protect|unprotect)",
+    [this](auto req, auto params)
+    {
+      auto clip = VideoID::Parse(params[0]);
+      if (!clip)
+        return restinio::request_rejected();
+
+      // Touches the marker file and the manifest
+      return OffLoop(workers, req, [this, clip = clip.value(), isProtected = params[1] == "protect"](auto req)
+      {
+        auto result = library.ProtectClip(clip, isProtected);
+
+        init(req->create_response())
+          .append_header(restinio::http_field::content_type, "text/plain; charset=utf-8")
+          .set_body(result ? "true" : "false")
+          .done();
+      });
     });
 
   router->http_get(
-    "/settings",
-    [this](auto req, auto)
+    "/cameras/(\\d+)/settings",
+    [this](auto req, auto params)
     {
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
       json settings;
       for (auto property : CameraPropertyEntries)
-        settings[std::string(property.second)] = camera.GetProperty(property.first);
+        settings[std::string(property.second)] = camera->GetProperty(property.first);
       return init(req->create_response())
         .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
         .set_body(settings.dump())
@@ -195,32 +574,42 @@ inline auto Server::CreateHandler()
     });
 
   router->http_post(
-    "/settings",
-    [this](restinio::request_handle_t req, auto)
+    "/cameras/(\\d+)/settings",
+    [this](restinio::request_handle_t req, auto params)
     {
-      const auto parameters = restinio::parse_query(req->body());
-      for (auto property : CameraPropertyEntries)
-        camera.SetProperty(property.first, restinio::value_or(parameters, property.second, camera.GetProperty(property.first)));
-      camera.ApplyPropertyChange();
-      return init(req->create_response())
-        .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
-        .set_body("{}")
-        .done();
+      Camera* camera = FindCamera(params[0]);
+      if (!camera)
+        return restinio::request_rejected();
+
+      // Writes the settings file
+      return OffLoop(workers, req, [camera](restinio::request_handle_t req)
+      {
+        const auto parameters = restinio::parse_query(req->body());
+        for (auto property : CameraPropertyEntries)
+          camera->SetProperty(property.first, restinio::value_or(parameters, property.second, camera->GetProperty(property.first)));
+        camera->ApplyPropertyChange();
+        init(req->create_response())
+          .append_header(restinio::http_field::content_type, "text/json; charset=utf-8")
+          .set_body("{}")
+          .done();
+      });
     });
 
-  StaticDirectoryMapper(router, fs, "js", "text/javascript; charset=utf-8");
-  StaticDirectoryMapper(router, fs, "css", "text/css; charset=utf-8");
-  StaticDirectoryMapper(router, fs, "svg", "image/svg+xml");
-  StaticDirectoryMapper(router, fs, "png", "image/png");
+  router->http_get(
+    "/(js|css|svg|png)/([a-zA-Z0-9\\.:-]+)",
+    [assets](auto req, auto params)
+    {
+      auto asset = assets->Find(fmt::format("{}/{}", std::string(params[0]), std::string(params[1])));
+      if (!asset)
+        return restinio::request_rejected();
+      return ServeAsset(req, *asset);
+    });
 
   router->http_get(
     "/",
-    [fs](auto req, auto)
+    [assets](auto req, auto)
     {
-      return init(req->create_response())
-        .append_header(restinio::http_field::content_type, "text/html; charset=utf-8")
-        .set_body(ReadFile(fs->open("index.html")))
-        .done();
+      return ServeAsset(req, *assets->Find("index.html"));
     });
 
   router->non_matched_request_handler(
@@ -262,13 +651,30 @@ public:
   }
 };
 
-Server::Server()
- : camera(library)
+Server::Server(const std::vector<std::string>& sources, EncodeBudget budget, RetentionPolicy retention, double streamFPS, size_t workerThreads)
+  : EPOCH(std::chrono::system_clock::now().time_since_epoch().count()),
+    library(budget, retention),
+    stream(streamFPS),
+    workers(std::max<size_t>(1, workerThreads))
+{
+  // Cameras are numbered in the order given; the number is their URL key
+  for (size_t i = 0; i < sources.size(); ++i)
+    cameras.push_back(std::make_unique<Camera>(library, uint16_t(i), sources[i]));
+}
+
+Camera* Server::FindCamera(std::string_view index)
 {
+  size_t i;
+  auto [end, error] = std::from_chars(index.data(), index.data() + index.size(), i);
+  if (error != std::errc() || end != index.data() + index.size() || i >= cameras.size())
+    return nullptr;
+  return cameras[i].get();
 }
 
-void Server::Run(const std::string& address, uint16_t port)
+void Server::Run(const std::string& address, uint16_t port, size_t threads)
 {
+  // The default traits put each connection on a strand, which is what makes
+  // running the loop on several threads safe
   using traits_t =
     restinio::traits_t<
       restinio::asio_timer_manager_t,
@@ -276,7 +682,7 @@ void Server::Run(const std::string& address, uint16_t port)
       router_t>;
 
   restinio::run(
-    restinio::on_this_thread<traits_t>()
+    restinio::on_thread_pool<traits_t>(std::max<size_t>(1, threads))
       .port(port)
       .address(address)
       .request_handler(CreateHandler()));
@@ -19,18 +19,35 @@
 #define SERVER_HPP
 
 #include "Camera.hpp"
+#include "LiveStream.hpp"
+
+#include <boost/asio/thread_pool.hpp>
+#include <memory>
+#include <string_view>
+#include <vector>
 
 class Server
 {
 public:
-  Server();
-  
-  void Run(const std::string& address, uint16_t port);
+  Server(const std::vector<std::string>& sources, EncodeBudget budget, RetentionPolicy retention, double streamFPS, size_t workerThreads);
+
+  // threads run the HTTP I/O loop; handlers that block hand off to a
+  // separate pool of workerThreads
+  void Run(const std::string& address, uint16_t port, size_t threads);
 private:
   inline auto CreateHandler();
+  Camera* FindCamera(std::string_view index);
 
-  Camera camera;
+  // Preview generations start over with every run; this keeps the live
+  // image's ETags from one run matching those of the next
+  const int64_t EPOCH;
+  // Every camera shares the one library, and with it the encode pool
   VideoLibrary library;
+  std::vector<std::unique_ptr<Camera>> cameras;
+  // Declared after the cameras so it stops streaming before they go away
+  LiveStream stream;
+  // Last, so queued handlers are abandoned before anything they use is gone
+  boost::asio::thread_pool workers;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "StaticAssets.hpp"
+
+#include <algorithm>
+#include <cmrc/cmrc.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <functional>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+CMRC_DECLARE(web_resources);
+
+struct AssetType
+{
+  std::string_view extension;
+  std::string_view mime;
+};
+
+constexpr std::array<AssetType, 5> ASSET_TYPES =
+{ {
+  { ".html", "text/html; charset=utf-8" },
+  { ".js", "text/javascript; charset=utf-8" },
+  { ".css", "text/css; charset=utf-8" },
+  { ".svg", "image/svg+xml" },
+  { ".png", "image/png" }
+} };
+
+// Suffixes of the precompressed copies, by ContentEncoding
+constexpr std::array<std::string_view, 3> ENCODING_SUFFIXES = { "", ".gz", ".br" };
+constexpr std::array<std::string_view, 3> ENCODING_NAMES = { "identity", "gzip", "br" };
+
+// Only a file with its version in the name can be cached without asking
+// again; anything else (bootstrap.min.css included) may change under the
+// same name with the next build, so it is revalidated against its ETag
+constexpr std::string_view CACHE_VERSIONED = "public, max-age=604800";
+constexpr std::string_view CACHE_REVALIDATE = "no-cache";
+
+bool EndsWith(std::string_view text, std::string_view suffix)
+{
+  return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+// A dash followed by a digit in the file name, as in jquery-3.5.1.min.js
+bool IsVersioned(std::string_view path)
+{
+  auto name = path.substr(path.rfind('/') + 1);
+  for (auto dash = name.find('-'); dash != std::string_view::npos; dash = name.find('-', dash + 1))
+  {
+    if (dash + 1 < name.size() && std::isdigit(static_cast<unsigned char>(name[dash + 1])))
+      return true;
+  }
+  return false;
+}
+
+// FNV-1a; the tag only has to change when the content does
+uint64_t Fingerprint(std::string_view data)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data)
+  {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+StaticAssets::StaticAssets()
+{
+  auto fs = cmrc::web_resources::get_filesystem();
+
+  std::vector<std::string> files;
+  std::function<void(const std::string&)> walk = [&](const std::string& directory)
+  {
+    for (const auto& entry : fs.iterate_directory(directory))
+    {
+      auto path = directory.empty() ? entry.filename() : directory + "/" + entry.filename();
+      if (entry.is_directory())
+        walk(path);
+      else
+        files.push_back(path);
+    }
+  };
+  walk("");
+
+  for (const auto& path : files)
+  {
+    auto type = std::find_if(ASSET_TYPES.begin(), ASSET_TYPES.end(), [&](const AssetType& type) { return EndsWith(path, type.extension); });
+    if (type == ASSET_TYPES.end())
+      continue;
+
+    StaticAsset asset;
+    asset.mime = type->mime;
+    asset.cacheControl = IsVersioned(path) ? CACHE_VERSIONED : CACHE_REVALIDATE;
+    for (size_t encoding = 0; encoding < ENCODING_SUFFIXES.size(); ++encoding)
+    {
+      auto encodedPath = path + std::string(ENCODING_SUFFIXES[encoding]);
+      if (!fs.exists(encodedPath))
+        continue;
+      auto file = fs.open(encodedPath);
+      asset.bodies[encoding] = std::string_view(file.begin(), file.size());
+    }
+    // Each encoding is its own representation, so each gets its own tag
+    auto fingerprint = Fingerprint(asset.bodies[size_t(ContentEncoding::Identity)]);
+    for (size_t encoding = 0; encoding < ENCODING_SUFFIXES.size(); ++encoding)
+      asset.etags[encoding] = fmt::format("\"{:016x}{}\"", fingerprint, ENCODING_SUFFIXES[encoding]);
+
+    assets.emplace(path, std::move(asset));
+  }
+
+  spdlog::get("web")->debug("Loaded {} static assets", assets.size());
+}
+
+const StaticAsset* StaticAssets::Find(std::string_view path) const
+{
+  auto asset = assets.find(std::string(path));
+  return asset == assets.end() ? nullptr : &asset->second;
+}
+
+ContentEncoding StaticAssets::Negotiate(const StaticAsset& asset, std::string_view acceptEncoding)
+{
+  auto accepts = [&](std::string_view name)
+  {
+    // Comma separated codings, each optionally followed by ;q=<weight>
+    size_t start = 0;
+    while (start < acceptEncoding.size())
+    {
+      size_t end = std::min(acceptEncoding.find(',', start), acceptEncoding.size());
+      auto coding = acceptEncoding.substr(start, end - start);
+      start = end + 1;
+
+      auto parameters = std::min(coding.find(';'), coding.size());
+      auto token = coding.substr(0, parameters);
+      token.remove_prefix(std::min(token.find_first_not_of(" \t"), token.size()));
+      token = token.substr(0, std::min(token.find_last_not_of(" \t") + 1, token.size()));
+      if (!std::equal(token.begin(), token.end(), name.begin(), name.end(), [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }))
+        continue;
+
+      auto weight = coding.substr(parameters);
+      auto q = weight.find("q=");
+      return q == std::string_view::npos || std::strtod(std::string(weight.substr(q + 2)).c_str(), nullptr) > 0;
+    }
+    return false;
+  };
+
+  if (!asset.bodies[size_t(ContentEncoding::Brotli)].empty() && accepts("br"))
+    return ContentEncoding::Brotli;
+  if (!asset.bodies[size_t(ContentEncoding::Gzip)].empty() && accepts("gzip"))
+    return ContentEncoding::Gzip;
+  return ContentEncoding::Identity;
+}
+
+std::string_view StaticAssets::GetName(ContentEncoding encoding)
+{
+  return ENCODING_NAMES[size_t(encoding)];
+}
\ No newline at end of file
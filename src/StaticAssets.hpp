@@ -0,0 +1,59 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATICASSETS_HPP
+#define STATICASSETS_HPP
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+enum class ContentEncoding
+{
+  Identity = 0,
+  Gzip = 1,
+  Brotli = 2
+};
+
+struct StaticAsset
+{
+  std::string_view mime;
+  std::string_view cacheControl;
+  // Indexed by ContentEncoding, pointing straight into the embedded
+  // resources; an encoding that wasn't built is left empty
+  std::array<std::string_view, 3> bodies;
+  std::array<std::string, 3> etags;
+};
+
+// The dashboard files, read once from the embedded resources along with any
+// precompressed copies the build made of them
+class StaticAssets
+{
+public:
+  StaticAssets();
+
+  const StaticAsset* Find(std::string_view path) const;
+  // Smallest encoding of the asset the client will take, going by an
+  // Accept-Encoding header
+  static ContentEncoding Negotiate(const StaticAsset& asset, std::string_view acceptEncoding);
+  static std::string_view GetName(ContentEncoding encoding);
+private:
+  std::unordered_map<std::string, StaticAsset> assets;
+};
+
+#endif
\ No newline at end of file
@@ -17,25 +17,139 @@
 
 #include "VideoID.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+#include <tuple>
 #include <base64.h>
 
-VideoID::VideoID()
+constexpr uint8_t FORMAT = 1;
+constexpr size_t PACKED_BYTES = 15;
+constexpr size_t ENCODED_LENGTH = PACKED_BYTES / 3 * 4;
+constexpr std::string_view ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+static const boost::posix_time::ptime EPOCH(boost::gregorian::date(1970, 1, 1));
+
+// Big endian, so the encoded bytes read in time order
+template<typename T>
+void Pack(uint8_t*& out, T value)
+{
+  for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8)
+    *out++ = uint8_t(value >> shift);
+}
+
+template<typename T>
+T Unpack(const uint8_t*& in)
+{
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    value = T(value << 8) | *in++;
+  return value;
+}
+
+VideoID::VideoID(uint16_t camera)
+  : camera(camera)
+{
+  // The clock can stand still or step back; IDs never do
+  static std::atomic<int64_t> last(0);
+  static std::atomic<uint32_t> nextSequence(0);
+
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  int64_t previous = last.load();
+  do
+    time = std::max(now, previous + 1);
+  while (!last.compare_exchange_weak(previous, time));
+  sequence = nextSequence++;
+
+  std::array<uint8_t, PACKED_BYTES> packed;
+  uint8_t* out = packed.data();
+  Pack<uint8_t>(out, FORMAT);
+  Pack<uint64_t>(out, time);
+  Pack<uint16_t>(out, camera);
+  Pack<uint32_t>(out, sequence);
+
+  id.reserve(ENCODED_LENGTH);
+  for (size_t i = 0; i < PACKED_BYTES; i += 3)
+  {
+    uint32_t bits = (packed[i] << 16) | (packed[i + 1] << 8) | packed[i + 2];
+    for (int shift = 18; shift >= 0; shift -= 6)
+      id += ALPHABET[(bits >> shift) & 0x3F];
+  }
+}
+
+VideoID::VideoID(std::string_view id)
+{
+  if (!Decode(id) && !DecodeLegacy(id))
+    throw std::invalid_argument("not a clip ID: " + std::string(id));
+}
+
+std::optional<VideoID> VideoID::Parse(std::string_view id)
 {
-  auto timestamp = boost::posix_time::to_iso_extended_string(boost::posix_time::microsec_clock::local_time());
-  id = base64_encode(reinterpret_cast<const unsigned char*>(timestamp.c_str()), timestamp.length());
+  VideoID parsed;
+  if (parsed.Decode(id) || parsed.DecodeLegacy(id))
+    return parsed;
+  return std::nullopt;
 }
 
-VideoID::VideoID(const std::string& id)
-  : id(id)
+bool VideoID::Decode(std::string_view encoded)
 {
-  // try to decode
-  boost::posix_time::from_iso_extended_string(GetTimestamp());
+  static const auto values = []
+  {
+    std::array<int8_t, 256> values;
+    values.fill(-1);
+    for (size_t i = 0; i < ALPHABET.size(); ++i)
+      values[uint8_t(ALPHABET[i])] = int8_t(i);
+    return values;
+  }();
+
+  if (encoded.size() != ENCODED_LENGTH)
+    return false;
+
+  std::array<uint8_t, PACKED_BYTES> packed;
+  for (size_t i = 0, o = 0; i < ENCODED_LENGTH; i += 4, o += 3)
+  {
+    uint32_t bits = 0;
+    for (size_t j = 0; j < 4; ++j)
+    {
+      int8_t value = values[uint8_t(encoded[i + j])];
+      if (value < 0)
+        return false;
+      bits = (bits << 6) | uint32_t(value);
+    }
+    packed[o] = uint8_t(bits >> 16);
+    packed[o + 1] = uint8_t(bits >> 8);
+    packed[o + 2] = uint8_t(bits);
+  }
+
+  const uint8_t* in = packed.data();
+  if (Unpack<uint8_t>(in) != FORMAT)
+    return false;
+  time = int64_t(Unpack<uint64_t>(in));
+  camera = Unpack<uint16_t>(in);
+  sequence = Unpack<uint32_t>(in);
+  id = encoded;
+  return true;
 }
 
-VideoID::VideoID(const std::string_view id)
-  : VideoID(std::string(id))
+bool VideoID::DecodeLegacy(std::string_view encoded)
 {
+  try
+  {
+    // Base64 of a local time ISO string, from a single camera
+    time = ParseTime(base64_decode(std::string(encoded)));
+    camera = 0;
+    sequence = 0;
+    id = encoded;
+    return true;
+  }
+  catch (const std::exception&)
+  {
+    return false;
+  }
 }
 
 const std::string& VideoID::GetID() const
@@ -43,7 +157,49 @@ const std::string& VideoID::GetID() const
   return id;
 }
 
-const std::string VideoID::GetTimestamp() const
+std::string VideoID::GetTimestamp() const
+{
+  auto utc = EPOCH + boost::posix_time::microseconds(time / 1000);
+  return boost::posix_time::to_iso_extended_string(utc) + "Z";
+}
+
+int64_t VideoID::GetTime() const
+{
+  return time;
+}
+
+uint16_t VideoID::GetCamera() const
+{
+  return camera;
+}
+
+int64_t VideoID::ParseTime(const std::string& timestamp)
+{
+  bool utc = !timestamp.empty() && timestamp.back() == 'Z';
+  auto parsed = boost::posix_time::from_iso_extended_string(utc ? timestamp.substr(0, timestamp.size() - 1) : timestamp);
+  if (parsed.is_special())
+    throw std::invalid_argument("not a timestamp: " + timestamp);
+
+  auto fraction = parsed.time_of_day().fractional_seconds() * (1000000000 / boost::posix_time::time_duration::ticks_per_second());
+  if (utc)
+    return (parsed - EPOCH).total_seconds() * int64_t(1000000000) + fraction;
+
+  std::tm local = boost::posix_time::to_tm(parsed);
+  local.tm_isdst = -1;
+  return int64_t(std::mktime(&local)) * 1000000000 + fraction;
+}
+
+bool VideoID::operator<(const VideoID& other) const
+{
+  return std::tie(time, camera, sequence) < std::tie(other.time, other.camera, other.sequence);
+}
+
+bool VideoID::operator==(const VideoID& other) const
+{
+  return std::tie(time, camera, sequence) == std::tie(other.time, other.camera, other.sequence);
+}
+
+bool VideoID::operator!=(const VideoID& other) const
 {
-  return base64_decode(id);
+  return !(*this == other);
 }
\ No newline at end of file
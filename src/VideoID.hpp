@@ -18,19 +18,48 @@
 #ifndef VIDEOID_HPP
 #define VIDEOID_HPP
 
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 
+// Names a clip.  Current IDs pack UTC nanoseconds, the camera and a
+// sequence number into 15 bytes written as 20 URL-safe base64 characters;
+// names from older versions (base64 of a local time ISO string) still parse.
+// Comparison and ordering only look at the numbers.
 class VideoID
 {
 public:
-  VideoID();
-  explicit VideoID(const std::string& id);
-  explicit VideoID(const std::string_view id);
+  // A new ID for a clip from camera, later than and different from every
+  // ID made before it by this process
+  explicit VideoID(uint16_t camera);
+  // Throws std::invalid_argument if id is neither form
+  explicit VideoID(std::string_view id);
+  static std::optional<VideoID> Parse(std::string_view id);
 
   const std::string& GetID() const;
-  const std::string GetTimestamp() const;
+  // ISO 8601 in UTC
+  std::string GetTimestamp() const;
+  // Nanoseconds since the epoch
+  int64_t GetTime() const;
+  uint16_t GetCamera() const;
+
+  // An ISO 8601 timestamp on GetTime's scale; without a trailing Z it's
+  // taken as local time
+  static int64_t ParseTime(const std::string& timestamp);
+
+  bool operator<(const VideoID& other) const;
+  bool operator==(const VideoID& other) const;
+  bool operator!=(const VideoID& other) const;
 private:
+  VideoID() = default;
+  bool Decode(std::string_view encoded);
+  bool DecodeLegacy(std::string_view encoded);
+
   std::string id;
+  int64_t time = 0;
+  uint16_t camera = 0;
+  uint32_t sequence = 0;
 };
 
 #endif
\ No newline at end of file
@@ -19,76 +19,183 @@
 
 #include "Platform.hpp"
 
-#include <boost/asio/post.hpp>
-#include <fmt/format.h>
+#include <fstream>
 #include <spdlog/spdlog.h>
 
 namespace fs = std::filesystem;
 
-VideoLibrary::VideoLibrary()
-  : pool(5),
-    videoPath(GetDataPath() / "videolib")
+uint64_t ClipBytes(const fs::path& libraryPath, const VideoID& clip)
+{
+  uint64_t bytes = 0;
+  std::error_code error;
+  for (const auto& path : ClipIndex::GetClipFiles(libraryPath, clip))
+  {
+    auto size = fs::file_size(path, error);
+    if (!error)
+      bytes += size;
+  }
+  return bytes;
+}
+
+// Written once the clip is, just before it joins the index
+void WriteTrace(const fs::path& libraryPath, const VideoID& clip, const std::string& trace)
+{
+  auto path = ClipIndex::GetTracePath(libraryPath, clip);
+  std::ofstream file(path, std::ios_base::binary);
+  if (!file.write(trace.data(), trace.size()))
+    spdlog::get("library")->error("Unable to write trace {}", path.string());
+}
+
+StillPaths GetStillPaths(const fs::path& libraryPath, const VideoID& clip)
+{
+  StillPaths paths;
+  for (auto size : magic_enum::enum_values<StillSize>())
+    paths[magic_enum::enum_integer(size)] = ClipIndex::GetStillPath(libraryPath, clip, size);
+  return paths;
+}
+
+VideoLibrary::VideoLibrary(EncodeBudget budget, RetentionPolicy retention)
+  : VideoLibrary(budget, retention, GetDataPath())
+{
+}
+
+VideoLibrary::VideoLibrary(EncodeBudget budget, RetentionPolicy retention, const fs::path& dataPath)
+  : videoPath(dataPath / "videolib"),
+    index(videoPath),
+    retention(retention, index, videoPath, [this](const VideoID& clip) { DeleteClip(clip); }),
+    scheduler(budget, dataPath / "spill")
 {
-  if (!fs::exists(videoPath))
-    fs::create_directories(videoPath);
-  
   spdlog::get("library")->info("Using \"{}\" as library path", videoPath.string());
 }
 
-void VideoLibrary::SaveClip(std::shared_ptr<std::vector<cv::Mat>> clip, cv::Size clipSize, double fps, size_t seekBackThumbnail)
+VideoID VideoLibrary::SaveClip(uint16_t camera, std::shared_ptr<ClipFrames> clip, double fps, EncoderProfile profile, size_t peakSeekBack, std::string trace)
 {
-  auto encoded = VideoID().GetID();
-  auto videoName = videoPath / fmt::format("{}.webm", encoded);
-  auto thumbName = videoPath / fmt::format("{}.jpeg", encoded);
+  VideoID id(camera);
+  auto encoded = id.GetID();
+  auto videoName = ClipIndex::GetVideoPath(videoPath, id);
+  auto stillNames = GetStillPaths(videoPath, id);
+  // Shared rather than copied along with the job
+  auto traceData = std::make_shared<const std::string>(std::move(trace));
   
   spdlog::get("library")->info("Requested save for clip {} ({} MB)",
     videoName.string(),
-    double(clip->back().total() * clip->back().elemSize() * clip->size()) / 1024.0 / 1024.0);
+    double(clip->Bytes()) / 1024.0 / 1024.0);
 
-  boost::asio::post(pool, VideoSaveJob(clip, clipSize, fps, seekBackThumbnail, videoName, thumbName));
+  scheduler.Submit(encoded, clip, [=](std::shared_ptr<ClipFrames> frames)
+  {
+    // Cores are shared between the encodes running when this one starts
+    VideoSaveJob(frames, fps, profile, scheduler.GetConcurrency(), peakSeekBack, videoName, stillNames)();
+    if (fs::exists(ClipIndex::GetStillPath(videoPath, id, StillSize::Thumbnail)))
+    {
+      WriteTrace(videoPath, id, *traceData);
+      index.Add({ id, ClipBytes(videoPath, id) });
+      retention.Notify();
+    }
+  });
+  return id;
 }
 
-std::vector<VideoID> VideoLibrary::GetClips() const
+VideoID VideoLibrary::SaveSegments(uint16_t camera, std::shared_future<SegmentList> segments, std::shared_ptr<ClipFrames> thumbnailFrames, size_t peakSeekBack, std::string trace)
 {
-  std::vector<VideoID> clips;
-  for (auto& clip : fs::directory_iterator(videoPath))
+  VideoID id(camera);
+  auto encoded = id.GetID();
+  auto videoName = ClipIndex::GetVideoPath(videoPath, id);
+  auto stillNames = GetStillPaths(videoPath, id);
+  // Shared rather than copied along with the job
+  auto traceData = std::make_shared<const std::string>(std::move(trace));
+
+  spdlog::get("library")->info("Requested stitch for clip {}", videoName.string());
+
+  // The frames here are only there to take the stills from; the clip itself
+  // is in the segments, so this can't be merged with anything
+  scheduler.Submit(encoded, thumbnailFrames, [=](std::shared_ptr<ClipFrames> frames)
   {
-    auto clipName = clip.path().filename();
-    if (clipName.extension() == ".jpeg")
-      clips.push_back(VideoID(clipName.stem().string()));
-  }
-  return clips;
+    SegmentStitchJob(segments, frames, peakSeekBack, videoName, stillNames)();
+    if (fs::exists(ClipIndex::GetStillPath(videoPath, id, StillSize::Thumbnail)))
+    {
+      WriteTrace(videoPath, id, *traceData);
+      index.Add({ id, ClipBytes(videoPath, id) });
+      retention.Notify();
+    }
+  }, false);
+  return id;
+}
+
+ClipPage VideoLibrary::GetClips(const ClipQuery& query) const
+{
+  return index.Query(query);
 }
 
-std::optional<fs::path> VideoLibrary::GetClipThumbnailPath(const VideoID& name) const
+std::string VideoLibrary::GetClipsVersion() const
+{
+  return index.GetVersion();
+}
+
+std::optional<fs::path> VideoLibrary::GetClipStillPath(const VideoID& name, StillSize size) const
 {
   return fs::exists(videoPath) ?
-    std::optional((videoPath / name.GetID()).replace_extension("jpeg")) :
+    std::optional(ClipIndex::GetStillPath(videoPath, name, size)) :
     std::nullopt;
 }
 
 std::optional<fs::path> VideoLibrary::GetClipVideoPath(const VideoID& name) const
 {
   return fs::exists(videoPath) ?
-    std::optional((videoPath / name.GetID()).replace_extension("webm")) :
+    std::optional(ClipIndex::GetVideoPath(videoPath, name)) :
+    std::nullopt;
+}
+
+std::optional<fs::path> VideoLibrary::GetClipTracePath(const VideoID& name) const
+{
+  return fs::exists(videoPath) ?
+    std::optional(ClipIndex::GetTracePath(videoPath, name)) :
     std::nullopt;
 }
 
 bool VideoLibrary::DeleteClip(const VideoID& name)
 {
-  auto path = GetClipVideoPath(name);
-  bool success = false;
-  if (path && fs::exists(path.value()))
-  {
-    fs::remove(path.value());
-    success = true;
-  }
-  path = GetClipThumbnailPath(name);
-  if (path && fs::exists(path.value()))
-  {
-    fs::remove(path.value());
-    return success;
-  }
+  index.Remove(name);
+  std::error_code error;
+  fs::remove(ClipIndex::GetProtectionMarker(videoPath, name), error);
+
+  // Clips from before the larger stills and traces existed only have a
+  // thumbnail, so those are allowed to be missing
+  bool video = fs::remove(ClipIndex::GetVideoPath(videoPath, name), error);
+  bool thumbnail = fs::remove(ClipIndex::GetStillPath(videoPath, name, StillSize::Thumbnail), error);
+  for (auto size : { StillSize::Medium, StillSize::Full })
+    fs::remove(ClipIndex::GetStillPath(videoPath, name, size), error);
+  fs::remove(ClipIndex::GetTracePath(videoPath, name), error);
+  return video && thumbnail;
+}
 
+bool VideoLibrary::ProtectClip(const VideoID& name, bool isProtected)
+{
+  // The marker goes first, so a crash in between errs on the side of
+  // keeping the clip
+  auto marker = ClipIndex::GetProtectionMarker(videoPath, name);
+  std::error_code error;
+  if (isProtected)
+    std::ofstream(marker, std::ios_base::binary);
+  else
+    fs::remove(marker, error);
+
+  if (index.SetProtected(name, isProtected))
+    return true;
+  fs::remove(marker, error);
   return false;
+}
+
+EncodeStatus VideoLibrary::GetEncodeStatus()
+{
+  return scheduler.GetStatus();
+}
+
+size_t VideoLibrary::GetEncodeConcurrency()
+{
+  return scheduler.GetConcurrency();
+}
+
+LibraryStatus VideoLibrary::GetLibraryStatus() const
+{
+  return retention.GetStatus();
 }
\ No newline at end of file
@@ -19,26 +19,46 @@
 #define VIDEOLIBRARY_HPP
 
 #include "VideoID.hpp"
+#include "ClipIndex.hpp"
+#include "RetentionManager.hpp"
 #include "VideoSaveJob.hpp"
+#include "SegmentStitchJob.hpp"
+#include "EncodeScheduler.hpp"
 
 #include <vector>
 #include <optional>
-#include <boost/asio/thread_pool.hpp>
 
 class VideoLibrary
 {
 public:
-  VideoLibrary();
+  explicit VideoLibrary(EncodeBudget budget = EncodeBudget(), RetentionPolicy retention = RetentionPolicy());
+  // Keeps clips (and spilled encodes) under dataPath instead of the user's
+  // data directory
+  VideoLibrary(EncodeBudget budget, RetentionPolicy retention, const std::filesystem::path& dataPath);
 
-  void SaveClip(std::shared_ptr<std::vector<cv::Mat>> clip, cv::Size clipSize, double fps, size_t seekBackThumbnail);
-  std::vector<VideoID> GetClips() const;
-  std::optional<std::filesystem::path> GetClipThumbnailPath(const VideoID& name) const;
+  // peakSeekBack places the frame the stills are taken from, counting back
+  // from the end of the clip (as VideoTrigger::GetPeakSeekBack); trace is
+  // the clip's IntensityTrace sidecar.  The clip turns up under the returned
+  // ID once it has been encoded
+  VideoID SaveClip(uint16_t camera, std::shared_ptr<ClipFrames> clip, double fps, EncoderProfile profile, size_t peakSeekBack, std::string trace);
+  VideoID SaveSegments(uint16_t camera, std::shared_future<SegmentList> segments, std::shared_ptr<ClipFrames> thumbnailFrames, size_t peakSeekBack, std::string trace);
+  ClipPage GetClips(const ClipQuery& query) const;
+  std::string GetClipsVersion() const;
+  std::optional<std::filesystem::path> GetClipStillPath(const VideoID& name, StillSize size) const;
   std::optional<std::filesystem::path> GetClipVideoPath(const VideoID& name) const;
+  std::optional<std::filesystem::path> GetClipTracePath(const VideoID& name) const;
   bool DeleteClip(const VideoID& name);
+  // Protected clips are never evicted; false if there's no such clip
+  bool ProtectClip(const VideoID& name, bool isProtected);
+  EncodeStatus GetEncodeStatus();
+  size_t GetEncodeConcurrency();
+  LibraryStatus GetLibraryStatus() const;
 private:
-  boost::asio::thread_pool pool;
-  double fps;
   std::filesystem::path videoPath;
+  ClipIndex index;
+  RetentionManager retention;
+  // Last, so encodes still running when it goes can finish into the index
+  EncodeScheduler scheduler;
 };
 
 #endif
\ No newline at end of file
@@ -18,112 +18,70 @@
 #include "VideoSaveJob.hpp"
 
 #include <spdlog/spdlog.h>
-#include <opencv2/imgcodecs.hpp>
-#include <opencv2/imgproc.hpp>
 #include <ffmpegcpp/ffmpegcpp.h>
+#include <magic_enum.hpp>
 
-// Translated to constexpr from
-// https://rosettacode.org/wiki/Convert_decimal_number_to_rational#C
-// I have pretty much no idea how this works...but it do
-const AVRational NearestRational(double f)
-{
-  int h[3] = { 0, 1, 0 };
-  int k[3] = { 1, 0, 0 };
-  int n = 1;
-  int neg = 0;
-  int md = 16;
-
-  if (f < 0)
-  {
-    neg = 1;
-    f = -f;
-  }
-
-  while (f != floor(f))
-  {
-    n <<= 1;
-    f *= 2;
-  }
-  int d = f;
-  
-  for (int i = 0; i < 64; ++i)
-  {
-    int a = n ? d / n : 0;
-    if (i && !a)
-      break;
-
-    int x = d;
-    d = n;
-    n = x % n;
-
-    x = a;
-    if (k[1] * a + k[0] >= md)
-    {
-      x = (md - k[0]) / k[1];
-      if (x * 2 >= a || k[1] >= md)
-        i = 65;
-      else
-        break;
-    }
-
-    h[2] = x * h[1] + h[0]; h[0] = h[1]; h[1] = h[2];
-    k[2] = x * k[1] + k[0]; k[0] = k[1]; k[1] = k[2];
-  }
-
-  return AVRational { neg ? -h[1] : h[1], k[1] };
-}
-
-constexpr AVRational Inverse(const AVRational& v)
-{
-  return AVRational { v.den, v.num };
-}
+#include "FFmpegUtils.hpp"
 
 VideoSaveJob::VideoSaveJob(
-  std::shared_ptr<std::vector<cv::Mat>> data,
-  cv::Size dimensions,
+  std::shared_ptr<ClipFrames> data,
   double fps,
-  size_t seekBackThumbnail,
+  EncoderProfile profile,
+  size_t concurrency,
+  size_t peakSeekBack,
   std::filesystem::path videoPath,
-  std::filesystem::path thumbPath)
-  : data(data), dimensions(dimensions), fps(fps),
-    seekBackThumbnail(seekBackThumbnail), videoPath(videoPath),
-    thumbPath(thumbPath)
+  StillPaths stillPaths)
+  : data(data), fps(fps), profile(profile), concurrency(concurrency),
+    peakSeekBack(peakSeekBack), videoPath(videoPath),
+    stillPaths(stillPaths)
 {}
 
 void VideoSaveJob::operator()()
 {
-  spdlog::get("library")->info("Started save for clip {}", videoPath.string());
+  spdlog::get("library")->info("Started save for clip {} ({} profile)", videoPath.string(), magic_enum::enum_name(profile));
   auto rationalFPS = NearestRational(fps);
   spdlog::get("library")->info("Estimated FPS at {}/{}", rationalFPS.num, rationalFPS.den);
 
-  ffmpegcpp::Muxer muxer(videoPath.string());
-  ffmpegcpp::VideoCodec codec("libvpx");
-  codec.SetBitRate(0);
-  codec.SetOption("crf", 4);
-  ffmpegcpp::VideoEncoder encoder(&codec, &muxer, rationalFPS, AV_PIX_FMT_BGRA);
-  ffmpegcpp::RawVideoDataSource output(dimensions.width, dimensions.height, AV_PIX_FMT_BGRA, rationalFPS, &encoder);
-
-  unsigned i = 0;
-  for (const cv::Mat& srcFrame : *data)
+  try
   {
-    if (srcFrame.empty())
+    // Grab the stills first; frames are handed back to the ring as soon as
+    // they are encoded
+    StillImages stills = MakeStills(*data, peakSeekBack);
+    cv::Mat scratch;
+
+    cv::Size dimensions = data->Dimensions();
+    ffmpegcpp::Muxer muxer(videoPath.string());
+    auto codec = MakeCodec(profile, dimensions, rationalFPS, concurrency);
+    // Frames go in as the BGR they are stored in; the data source's scaler
+    // turns them into I420 for libvpx in one pass, with buffers it keeps
+    // between frames
+    ffmpegcpp::VideoEncoder encoder(codec.get(), &muxer, rationalFPS, AV_PIX_FMT_YUV420P);
+    ffmpegcpp::RawVideoDataSource output(dimensions.width, dimensions.height, AV_PIX_FMT_BGR24, rationalFPS, &encoder);
+
+    for (size_t i = 0; i < data->Size(); ++i)
     {
-      spdlog::get("library")->trace("Empty frame {}", i);
-      ++i;
-      continue;
+      const cv::Mat& srcFrame = data->Get(i, scratch);
+      if (srcFrame.empty())
+      {
+        spdlog::get("library")->trace("Empty frame {}", i);
+        data->Release(i);
+        continue;
+      }
+      output.WriteFrame(srcFrame.data, int(srcFrame.step[0]));
+      data->Release(i);
+      spdlog::get("library")->trace("Wrote frame {}/{}", i, data->Size());
     }
-    cv::Mat dstFrame;
-    cv::cvtColor(srcFrame, dstFrame, cv::COLOR_BGR2BGRA);
-    output.WriteFrame(dstFrame.data, 4 * output.GetWidth());
-    spdlog::get("library")->trace("Wrote frame {}/{}", i++, data->size());
-  }
-  output.Close();
+    output.Close();
 
-  cv::Mat originalThumbnail = (*data)[data->size() - seekBackThumbnail];
-  cv::Mat thumbnail;
-  if (originalThumbnail.empty())
-    originalThumbnail = data->back();
-  cv::resize(originalThumbnail, thumbnail, cv::Size(128, 96));
-  cv::imwrite(thumbPath.string(), thumbnail);
-  spdlog::get("library")->info("Clip saved as {}", videoPath.string());
+    if (WriteStills(stills, stillPaths))
+      spdlog::get("library")->info("Clip saved as {}", videoPath.string());
+    else
+      DiscardClip(videoPath, stillPaths);
+  }
+  catch (...)
+  {
+    // The muxer is closed by now, so whatever it wrote can go
+    DiscardClip(videoPath, stillPaths);
+    throw;
+  }
 }
\ No newline at end of file
@@ -18,6 +18,10 @@
 #ifndef VIDEOSAVEJOB_HPP
 #define VIDEOSAVEJOB_HPP
 
+#include "ClipFrames.hpp"
+#include "ClipStills.hpp"
+#include "EncoderProfile.hpp"
+
 #include <memory>
 #include <filesystem>
 #include <opencv2/core/mat.hpp>
@@ -26,22 +30,24 @@ class VideoSaveJob
 {
 public:
   VideoSaveJob(
-    std::shared_ptr<std::vector<cv::Mat>> data,
-    cv::Size dimensions,
+    std::shared_ptr<ClipFrames> data,
     double fps,
-    size_t seekBackThumbnail,
+    EncoderProfile profile,
+    size_t concurrency,
+    size_t peakSeekBack,
     std::filesystem::path videoPath,
-    std::filesystem::path thumbPath);
+    StillPaths stillPaths);
 
   void operator()();
 private:
-  std::shared_ptr<std::vector<cv::Mat>> data;
-  cv::Size dimensions;
+  std::shared_ptr<ClipFrames> data;
   double fps;
+  EncoderProfile profile;
+  size_t concurrency;
 
-  size_t seekBackThumbnail;
+  size_t peakSeekBack;
   std::filesystem::path videoPath;
-  std::filesystem::path thumbPath;
+  StillPaths stillPaths;
 };
 
 #endif
\ No newline at end of file
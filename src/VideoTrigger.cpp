@@ -17,52 +17,138 @@
 
 #include "VideoTrigger.hpp"
 
-#include <opencv2/core.hpp>
-#include <numeric>
+#include <algorithm>
+#include <limits>
 #include <spdlog/spdlog.h>
 
-#include "OpenCVUtils.hpp"
+// A perfectly static scene has no spread at all; don't let sensor noise of a
+// fraction of a level count as a many-sigma event
+constexpr double MIN_DEVIATION = 0.5;
 
-VideoTrigger::VideoTrigger(double fps, double edgeDetectionSeconds, double debounceSeconds, double triggerDelay, unsigned char triggerThreshold)
+VideoTrigger::VideoTrigger(double fps, double edgeDetectionSeconds, double debounceSeconds, double triggerDelay, unsigned char triggerThreshold, TriggerMode mode, double zScoreThreshold, size_t channels)
   : THRESHOLD_WINDOW(edgeDetectionSeconds * fps),
     DEBOUNCE_COUNT(debounceSeconds * fps),
     TRIP_THRESHOLD(triggerThreshold),
     POST_TRIGGER_COUNT(triggerDelay * fps),
-    thresholds(THRESHOLD_WINDOW, 0),
+    MODE(mode),
+    Z_THRESHOLD(zScoreThreshold),
+    thresholds(std::max<size_t>(1, channels), RollingStatistics<double>(THRESHOLD_WINDOW)),
+    baselines(thresholds.size()),
+    wasArmed(false),
+    wasSpike(false),
     currentDebounce(0),
     delayCount(0),
     isDelayed(false),
-    thresholdFilled(false),
-    initialFrameCount(THRESHOLD_WINDOW)
+    peakExcess(0),
+    framesSincePeak(0)
 {
 }
 
-size_t VideoTrigger::GetSeekForThumbnail() const
+size_t VideoTrigger::GetPeakSeekBack() const
 {
-  return POST_TRIGGER_COUNT;
+  return framesSincePeak + 1;
 }
 
-bool VideoTrigger::ShouldCapture(const cv::Mat& frame)
+const std::vector<double>& VideoTrigger::GetBaselines() const
 {
-  if (initialFrameCount != 0)
-    --initialFrameCount;
-  else
-    thresholdFilled = true;
-  
-  unsigned char threshold = MeanIntensity(frame);
-  thresholds.Push(threshold);
-  unsigned char mean = thresholds.Mean();
+  return baselines;
+}
+
+bool VideoTrigger::WasArmed() const
+{
+  return wasArmed;
+}
+
+bool VideoTrigger::WasSpike() const
+{
+  return wasSpike;
+}
+
+double VideoTrigger::GetExcess(const std::vector<double>& intensities) const
+{
+  double excess = -std::numeric_limits<double>::infinity();
+  for (size_t channel = 0; channel < intensities.size(); ++channel)
+    excess = std::max(excess, intensities[channel] - baselines[channel]);
+  return excess;
+}
+
+bool VideoTrigger::IsSpike(size_t channel, double intensity) const
+{
+  const auto& baseline = thresholds[channel];
+  double mean = baselines[channel];
+  switch (MODE)
+  {
+  case TriggerMode::ZScore:
+  {
+    double z = (intensity - mean) / std::max(baseline.StandardDeviation(), MIN_DEVIATION);
+    if (z > Z_THRESHOLD)
+    {
+      spdlog::get("camera")->info("Threshold event in tile {} ({:.1f} > {:.1f}, {:.1f} sigma)", channel, intensity, mean, z);
+      return true;
+    }
+    return false;
+  }
+  default:
+  case TriggerMode::Threshold:
+    if (intensity - mean > TRIP_THRESHOLD)
+    {
+      spdlog::get("camera")->info("Threshold event in tile {} ({:.1f} > {:.1f})", channel, intensity, mean);
+      return true;
+    }
+    return false;
+  }
+}
+
+bool VideoTrigger::ShouldCapture(const std::vector<double>& intensities)
+{
+  if (intensities.size() != thresholds.size())
+  {
+    spdlog::get("camera")->warn("Trigger expected {} tiles, got {}; ignoring frame", thresholds.size(), intensities.size());
+    return false;
+  }
 
   if (currentDebounce != 0)
     --currentDebounce;
 
-  if (thresholdFilled && !isDelayed && currentDebounce == 0 && threshold > mean && (threshold - mean) > TRIP_THRESHOLD)
+  for (size_t channel = 0; channel < intensities.size(); ++channel)
+    baselines[channel] = thresholds[channel].Mean();
+
+  // Compare against the window before this frame joins it, so a flash does
+  // not raise its own baseline.  Every window fills at the same rate, so the
+  // first one stands in for all of them
+  wasArmed = thresholds.front().Full() && !isDelayed && currentDebounce == 0;
+  wasSpike = false;
+  if (wasArmed)
+  {
+    for (size_t channel = 0; channel < intensities.size(); ++channel)
+    {
+      if (IsSpike(channel, intensities[channel]))
+      {
+        currentDebounce = DEBOUNCE_COUNT;
+        delayCount = POST_TRIGGER_COUNT;
+        isDelayed = true;
+        peakExcess = -std::numeric_limits<double>::infinity();
+        wasSpike = true;
+        break;
+      }
+    }
+  }
+
+  // The spike is rarely the brightest frame of a strike; follow it until
+  // the capture so the clip can be shown at its peak
+  if (isDelayed)
   {
-    currentDebounce = DEBOUNCE_COUNT;
-    delayCount = POST_TRIGGER_COUNT;
-    isDelayed = true;
-    spdlog::get("camera")->info("Threshold event ({} > {})", threshold, mean);
+    double excess = GetExcess(intensities);
+    if (excess > peakExcess)
+    {
+      peakExcess = excess;
+      framesSincePeak = 0;
+    }
+    else
+      ++framesSincePeak;
   }
+  for (size_t channel = 0; channel < intensities.size(); ++channel)
+    thresholds[channel].Push(intensities[channel]);
 
   if (delayCount != 0)
     --delayCount;
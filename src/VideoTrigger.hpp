@@ -18,29 +18,58 @@
 #ifndef VIDEOTRIGGER_HPP
 #define VIDEOTRIGGER_HPP
 
-#include <opencv2/core/mat.hpp>
+#include <cstddef>
+#include <vector>
 
-#include "MovingAverage.hpp"
+#include "RollingStatistics.hpp"
+
+enum class TriggerMode
+{
+  // Fixed brightness jump over the rolling mean
+  Threshold = 0,
+  // Jump measured in standard deviations of the rolling window, so noisy
+  // scenes need a bigger flash than quiet ones
+  ZScore = 1
+};
 
 class VideoTrigger
 {
 public:
-  VideoTrigger(double fps, double edgeDetectionSeconds = 2, double debounceSeconds = 1, double triggerDelay = 5, unsigned char triggerThreshold = 15);
+  // Each channel (one per detector tile) keeps its own baseline, and a
+  // spike in any of them triggers
+  VideoTrigger(double fps, double edgeDetectionSeconds = 2, double debounceSeconds = 1, double triggerDelay = 5, unsigned char triggerThreshold = 15, TriggerMode mode = TriggerMode::Threshold, double zScoreThreshold = 6, size_t channels = 1);
 
-  bool ShouldCapture(const cv::Mat& frame);
-  size_t GetSeekForThumbnail() const;
+  bool ShouldCapture(const std::vector<double>& intensities);
+  // After a capture, how far back from the newest frame the brightest one
+  // since the spike was; 1 is the newest frame itself
+  size_t GetPeakSeekBack() const;
+  // About the frame last passed to ShouldCapture, for the intensity trace:
+  // each tile's rolling mean from before the frame joined it, whether the
+  // frame was checked for a spike at all, and whether it was one
+  const std::vector<double>& GetBaselines() const;
+  bool WasArmed() const;
+  bool WasSpike() const;
 private:
+  bool IsSpike(size_t channel, double intensity) const;
+  // Brightest tile's rise over its own baseline
+  double GetExcess(const std::vector<double>& intensities) const;
+
   const size_t THRESHOLD_WINDOW;
   const size_t DEBOUNCE_COUNT;
   const unsigned char TRIP_THRESHOLD;
   const size_t POST_TRIGGER_COUNT;
+  const TriggerMode MODE;
+  const double Z_THRESHOLD;
 
-  MovingAverage<int> thresholds;
+  std::vector<RollingStatistics<double>> thresholds;
+  std::vector<double> baselines;
+  bool wasArmed;
+  bool wasSpike;
   size_t currentDebounce;
   size_t delayCount;
   bool isDelayed;
-  bool thresholdFilled;
-  size_t initialFrameCount;
+  double peakExcess;
+  size_t framesSincePeak;
 };
 
 #endif
\ No newline at end of file
@@ -20,6 +20,8 @@
 #include "FFmpegInit.hpp"
 
 #include <iostream>
+#include <string>
+#include <vector>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <boost/program_options/options_description.hpp>
@@ -39,12 +41,34 @@ int main(int argc, char** argv)
   uint16_t port;
   std::string address;
   bool verbose;
+  std::vector<std::string> cameras;
+  EncodeBudget budget;
+  size_t budgetMB;
+  std::string overflow;
+  double streamFPS;
+  size_t httpThreads;
+  size_t httpWorkers;
+  RetentionPolicy retention;
+  uint64_t quotaMB;
+  uint64_t reserveMB;
+  unsigned maxAgeDays;
   po::options_description desc("Allowed options");
   desc.add_options()
     ("help", "show help message")
     ("port", po::value(&port)->default_value(8080), "port number to listen on")
     ("address", po::value(&address)->default_value("localhost"), "address to bind to")
     ("verbose", po::bool_switch(&verbose)->default_value(false), "verbose logging")
+    ("camera", po::value(&cameras)->composing()->default_value({ "0" }, "0"), "camera device index or video source; repeat for more cameras")
+    ("encode-threads", po::value(&budget.threads)->default_value(budget.threads), "number of clips to encode at once")
+    ("encode-queue", po::value(&budget.maxQueued)->default_value(budget.maxQueued), "most clips to hold in memory waiting for an encoder")
+    ("encode-memory", po::value(&budgetMB)->default_value(budget.maxBytes / 1024 / 1024), "most memory in MB held by clips waiting for or being encoded")
+    ("encode-overflow", po::value(&overflow)->default_value("Merge"), "what to do when the encode queue is full (DropOldest, Merge or Spill)")
+    ("http-threads", po::value(&httpThreads)->default_value(2), "number of threads serving HTTP connections")
+    ("http-workers", po::value(&httpWorkers)->default_value(4), "number of threads for HTTP requests that touch the disk or block")
+    ("stream-fps", po::value(&streamFPS)->default_value(5), "most frames per second pushed to each live stream client")
+    ("library-quota", po::value(&quotaMB)->default_value(0), "most space in MB saved clips may take, oldest deleted first (0 for no limit)")
+    ("library-max-age", po::value(&maxAgeDays)->default_value(0), "days to keep unprotected clips (0 to keep them forever)")
+    ("library-reserve", po::value(&reserveMB)->default_value(retention.reserveBytes / 1024 / 1024), "free space in MB to leave on the disk, deleting the oldest clips to keep it (0 to turn this off)")
   ;
 
   po::variables_map v;
@@ -57,6 +81,18 @@ int main(int argc, char** argv)
     return 1;
   }
 
+  budget.maxBytes = budgetMB * 1024 * 1024;
+  retention.maxBytes = quotaMB * 1024 * 1024;
+  retention.reserveBytes = reserveMB * 1024 * 1024;
+  retention.maxAge = std::chrono::hours(24 * maxAgeDays);
+  if (auto policy = magic_enum::enum_cast<OverflowPolicy>(overflow); policy)
+    budget.policy = policy.value();
+  else
+  {
+    std::cout << "unknown encode-overflow policy " << overflow << std::endl;
+    return 1;
+  }
+
   spdlog::set_level(verbose ? spdlog::level::trace : spdlog::level::info);
 
   auto opencv   = spdlog::stdout_color_mt("opencv");
@@ -68,7 +104,7 @@ int main(int argc, char** argv)
 
   SetupOpenCVLogging();
   SetupFFmpegLogging();
-  Server().Run(address, port);
+  Server(cameras, budget, retention, streamFPS, httpWorkers).Run(address, port, httpThreads);
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Check.hpp"
+#include "Camera.hpp"
+#include "VideoLibrary.hpp"
+#include "OpenCVInit.hpp"
+#include "FFmpegInit.hpp"
+
+#include <opencv2/videoio.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+constexpr double FPS = 30;
+
+// Dark, a few bright frames, then dark for longer than the trigger delay,
+// so the camera saves exactly one clip each time it plays the file through
+void WriteFlash(const fs::path& path)
+{
+  const cv::Size size(160, 120);
+  cv::VideoWriter writer(path.string(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), FPS, size);
+  const cv::Mat dark(size, CV_8UC3, cv::Scalar::all(10));
+  const cv::Mat bright(size, CV_8UC3, cv::Scalar::all(250));
+  for (int i = 0; i < 4 * FPS; ++i)
+    writer.write(dark);
+  for (int i = 0; i < 3; ++i)
+    writer.write(bright);
+  for (int i = 0; i < 8 * FPS; ++i)
+    writer.write(dark);
+}
+
+bool WaitForClips(VideoLibrary& library, size_t clips)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  while (library.GetClips(ClipQuery()).total < clips)
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return true;
+}
+
+int main()
+{
+  const fs::path root = fs::temp_directory_path() / "stormwatch-camera-restart-test";
+  fs::remove_all(root);
+  fs::create_directories(root);
+  // Keep the camera's settings file out of the real config directory
+  setenv("XDG_CONFIG_HOME", (root / "config").c_str(), 1);
+
+  spdlog::stdout_color_mt("opencv");
+  spdlog::stdout_color_mt("camera")->set_level(spdlog::level::err);
+  spdlog::stdout_color_mt("library");
+  spdlog::stdout_color_mt("ffmpeg");
+  spdlog::stdout_color_mt("settings");
+  SetupOpenCVLogging();
+  SetupFFmpegLogging();
+
+  const fs::path video = root / "flash.avi";
+  WriteFlash(video);
+
+  {
+    VideoLibrary library(EncodeBudget(), RetentionPolicy(), root);
+    Camera camera(library, 0, video.string());
+
+    // A restarted camera plays the file from the top and has to trigger on
+    // the same flash again
+    camera.Start();
+    CHECK(WaitForClips(library, 1));
+    camera.Stop();
+    camera.Start();
+    CHECK(WaitForClips(library, 2));
+    camera.Stop();
+  }
+
+  fs::remove_all(root);
+
+  return CHECK_RESULT();
+}
\ No newline at end of file
@@ -15,15 +15,29 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#ifndef OPENCVUTILS_HPP
-#define OPENCVUTILS_HPP
+#ifndef CHECK_HPP
+#define CHECK_HPP
 
-#include <opencv2/core.hpp>
+#include <fmt/format.h>
 
-auto MeanIntensity(const cv::Mat& mat)
+// Tests are plain executables; a failed check is reported and turns into a
+// non-zero exit code for ctest
+inline int& CheckFailures()
 {
-  cv::Scalar bgrThreshold = cv::mean(mat);
-  return (bgrThreshold[0] + bgrThreshold[1] + bgrThreshold[2]) / 3;
+  static int failures = 0;
+  return failures;
 }
 
+#define CHECK(condition) \
+  do \
+  { \
+    if (!(condition)) \
+    { \
+      fmt::print(stderr, "{}:{}: check failed: {}\n", __FILE__, __LINE__, #condition); \
+      ++CheckFailures(); \
+    } \
+  } while (false)
+
+#define CHECK_RESULT() (CheckFailures() == 0 ? 0 : 1)
+
 #endif
\ No newline at end of file
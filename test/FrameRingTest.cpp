@@ -0,0 +1,77 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Check.hpp"
+#include "FrameRing.hpp"
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+constexpr size_t CAPACITY = 4;
+constexpr size_t SPARES = 2;
+
+int main()
+{
+  spdlog::stdout_color_mt("camera");
+
+  FrameRing ring(cv::Size(16, 8), CV_8UC1, CAPACITY, SPARES);
+  const size_t slots = ring.SlotCount();
+  CHECK(slots == CAPACITY + SPARES + 1);
+
+  for (size_t i = 0; i < CAPACITY; ++i)
+  {
+    ring.Next().setTo(cv::Scalar::all(double(i)));
+    CHECK(ring.Commit());
+  }
+
+  // Pin the whole ring, then keep capturing well past what the spares cover;
+  // the ring borrows slots rather than dropping frames
+  auto clip = ring.Snapshot();
+  for (size_t i = 0; i < CAPACITY * 3; ++i)
+  {
+    ring.Next().setTo(cv::Scalar::all(100.0));
+    CHECK(ring.Commit());
+  }
+  CHECK(ring.SlotCount() == slots + CAPACITY - SPARES);
+  CHECK(ring.Newest().at<uchar>(0, 0) == 100);
+
+  // The pinned frames were never written over
+  cv::Mat scratch;
+  for (size_t i = 0; i < clip->Size(); ++i)
+    CHECK(clip->Get(i, scratch).at<uchar>(0, 0) == uchar(i));
+
+  // Once the snapshot lets go its slots are spares again and the borrowed
+  // ones are handed back
+  clip.reset();
+  for (size_t i = 0; i < CAPACITY * 3; ++i)
+  {
+    ring.Next().setTo(cv::Scalar::all(200.0));
+    CHECK(ring.Commit());
+  }
+  CHECK(ring.SlotCount() == slots);
+  CHECK(ring.Newest().at<uchar>(0, 0) == 200);
+
+  // An adopted frame takes a slot's place and its buffer comes back free
+  cv::Mat grabbed(cv::Size(16, 8), CV_8UC1, cv::Scalar::all(50));
+  const uchar* adopted = grabbed.data;
+  CHECK(ring.Adopt(grabbed));
+  CHECK(ring.Newest().data == adopted);
+  CHECK(!grabbed.empty() && grabbed.data != adopted);
+  CHECK(ring.SlotCount() == slots);
+
+  return CHECK_RESULT();
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Check.hpp"
+#include "RetentionManager.hpp"
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Far more than any disk the test runs on has free
+constexpr uint64_t HUGE_CLIP = uint64_t(1) << 50;
+constexpr size_t HUGE_CLIPS = 4;
+// An old style ID: base64 of the local time 2020-01-01T00:00:00
+constexpr const char* OLD_CLIP = "MjAyMC0wMS0wMVQwMDowMDowMA==";
+
+// Polls instead of sleeping for a set time; the limit is only there so a
+// broken manager fails the test rather than hanging it
+template<typename Condition>
+bool WaitFor(Condition condition)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!condition())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+int main()
+{
+  spdlog::stdout_color_mt("library");
+  const fs::path libraryPath = fs::temp_directory_path() / "stormwatch-retention-test";
+  fs::remove_all(libraryPath);
+
+  {
+    ClipIndex index(libraryPath);
+    const VideoID old(OLD_CLIP);
+    index.Add({ old, 1 });
+    for (size_t i = 0; i < HUGE_CLIPS; ++i)
+      index.Add({ VideoID(0), HUGE_CLIP });
+
+    // Evicting takes a clip out of the index, as the library's callback does;
+    // otherwise the manager would find the same clip oldest every time
+    std::vector<VideoID> aged;
+    {
+      RetentionPolicy policy;
+      policy.maxAge = std::chrono::hours(24);
+      RetentionManager manager(policy, index, libraryPath, [&](const VideoID& id)
+      {
+        index.Remove(id);
+        aged.push_back(id);
+      });
+
+      // Without a quota or a reserve there's nothing to keep to, even though
+      // the disk's free space is known and the clips would never fit on it
+      CHECK(!manager.GetStatus().limited);
+
+      // The old clip goes in the first pass.  Stopping the manager waits for
+      // that pass to finish, so anything else it was going to evict is gone
+      // by the time it's checked
+      CHECK(WaitFor([&] { return manager.GetStatus().evicted != 0; }));
+    }
+    CHECK(aged.size() == 1 && aged.front() == old);
+    CHECK(index.GetUsage().clips == HUGE_CLIPS);
+
+    RetentionPolicy cap;
+    cap.maxBytes = 1;
+    RetentionManager capped(cap, index, libraryPath, [&](const VideoID& id) { index.Remove(id); });
+    CHECK(capped.GetStatus().limited);
+
+    // Every clip is over the quota on its own, and each goes exactly once
+    CHECK(WaitFor([&] { return capped.GetStatus().evicted >= HUGE_CLIPS; }));
+    CHECK(index.GetUsage().clips == 0);
+    CHECK(index.GetUsage().bytes == 0);
+    CHECK(capped.GetStatus().evicted == HUGE_CLIPS);
+  }
+
+  fs::remove_all(libraryPath);
+
+  return CHECK_RESULT();
+}
\ No newline at end of file
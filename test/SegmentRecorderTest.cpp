@@ -0,0 +1,95 @@
+/* stormwatch
+ * Copyright (C) 2020 Joe Dillon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Check.hpp"
+#include "SegmentRecorder.hpp"
+
+#include <ffmpegcpp/ffmpegcpp.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+const cv::Size DIMENSIONS(64, 48);
+constexpr double FPS = 10;
+
+class SolidFrame : public ClipFrames
+{
+public:
+  SolidFrame()
+    : frame(DIMENSIONS, CV_8UC3, cv::Scalar::all(128))
+  {
+  }
+
+  size_t Size() const override { return 1; }
+  cv::Size Dimensions() const override { return DIMENSIONS; }
+  size_t Bytes() const override { return frame.total() * frame.elemSize(); }
+  const cv::Mat& Get(size_t, cv::Mat&) const override { return frame; }
+private:
+  cv::Mat frame;
+};
+
+// Stands in for the encoder giving up halfway through a segment
+class FailingFrame : public SolidFrame
+{
+public:
+  const cv::Mat& Get(size_t, cv::Mat&) const override
+  {
+    throw ffmpegcpp::FFmpegException("forced failure");
+  }
+};
+
+// Every file in the directory belongs to one of the segments
+bool OnlySegments(const fs::path& directory, const SegmentList& segments)
+{
+  for (const auto& entry : fs::directory_iterator(directory))
+    if (std::none_of(segments.begin(), segments.end(), [&](const auto& segment) { return segment->path == entry.path(); }))
+      return false;
+  return true;
+}
+
+int main()
+{
+  spdlog::stdout_color_mt("library");
+  const fs::path directory = fs::temp_directory_path() / "stormwatch-segment-test";
+
+  {
+    SegmentRecorder recorder(directory, DIMENSIONS, FPS, 1, 3, EncoderProfile::Realtime, 1);
+
+    // Fail just short of the end of the first segment, well after the
+    // encoder has started writing it out
+    for (int i = 0; i < 9; ++i)
+      recorder.Push(std::make_shared<SolidFrame>());
+    recorder.Push(std::make_shared<FailingFrame>());
+    SegmentList failed = recorder.Cut().get();
+    CHECK(failed.empty());
+    CHECK(fs::is_empty(directory));
+
+    // The recorder carries on with a fresh segment afterwards
+    for (int i = 0; i < 5; ++i)
+      recorder.Push(std::make_shared<SolidFrame>());
+    SegmentList recovered = recorder.Cut().get();
+    CHECK(recovered.size() == 1);
+    CHECK(OnlySegments(directory, recovered));
+  }
+
+  CHECK(fs::is_empty(directory));
+  fs::remove_all(directory);
+
+  return CHECK_RESULT();
+}
\ No newline at end of file
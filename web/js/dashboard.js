@@ -16,10 +16,21 @@
  */
 
 $(document).ready(function() {
+  var camera = "0";
+  var cameraUrl = function(path)
+  {
+    return "cameras/" + camera + "/" + path;
+  };
+
+  // The server pushes new frames down the one connection
+  var openLive = function()
+  {
+    $("#live").attr("src", cameraUrl("live.mjpeg"));
+  };
+
   setInterval(function()
   {
-    $("#live").attr("src", "live.jpeg?" + (new Date()).getTime());
-    $.getJSON("stats", function(data)
+    $.getJSON(cameraUrl("stats"), function(data)
     {
       $("#camera-width").val(data.width);
       $("#camera-height").val(data.height);
@@ -31,9 +42,9 @@ $(document).ready(function() {
   $('#camera-enabled').change(function()
   {
     if (this.checked)
-      $.post("start");
+      $.post(cameraUrl("start"));
     else
-      $.post("stop");
+      $.post(cameraUrl("stop"));
   });
 
   var video = document.getElementById("videoPreview");
@@ -41,15 +52,19 @@ $(document).ready(function() {
   video.appendChild(source);
   video.type = "video/mp4";
 
-  var updateVideos = function()
+  // Clips come newest first, a page at a time
+  var CLIPS_PER_PAGE = 50;
+  var clipsShown = 0;
+
+  var loadVideos = function()
   {
     $("#loader").show();
-    $("#videoList").empty();
-    $.getJSON("clips", function(data)
+    $.getJSON("clips", { offset: clipsShown, limit: CLIPS_PER_PAGE }, function(data)
     {
       var template = $('#video-template').html();
-      $.each(data, function(key, val)
+      $.each(data.clips, function(index, val)
       {
+        var key = clipsShown + index;
         var title = new Date(Date.parse(val.title));
         $('#videoList').append(template
           .replace("{title}", title)
@@ -58,6 +73,7 @@ $(document).ready(function() {
           .replace("{thumbnail_id}", "thumbnail" + key)
           .replace("{title_id}", "title" + key)
           .replace("{delete_id}", "delete" + key)
+          .replace("{protect_id}", "protect" + key)
           .replace("{item_id}", "mediaItem" + key));
         
         var showHandler = function()
@@ -66,6 +82,8 @@ $(document).ready(function() {
           var source = video.firstChild;
 
           video.pause();
+          // Shown at the strike's peak until the clip has loaded
+          video.setAttribute("poster", val.preview);
           source.setAttribute("src", val.video); 
         
           video.load();
@@ -88,39 +106,118 @@ $(document).ready(function() {
           });
         };
 
+        // Kept clips are never deleted to make room; the lock shows dimmed
+        // on clips that may be
+        var isProtected = val.protected;
+        $("#protect" + key).toggleClass("unprotected", !isProtected);
+        var protectHandler = function()
+        {
+          var url = "clips/" + val.id + (isProtected ? "/unprotect" : "/protect");
+          $.post(url, function(result)
+          {
+            if (result)
+            {
+              isProtected = !isProtected;
+              $("#protect" + key).toggleClass("unprotected", !isProtected);
+            }
+          });
+        };
+
         $("#thumbnail" + key).click(showHandler);
         $("#title" + key).click(showHandler);
         $("#delete" + key).click(deleteHandler);
+        $("#protect" + key).click(protectHandler);
       });
+      clipsShown += data.clips.length;
+      $("#olderClips").toggle(clipsShown < data.total);
       $("#loader").hide();
     });
-  }
+  };
+
+  var updateVideos = function()
+  {
+    clipsShown = 0;
+    $("#videoList").empty();
+    loadVideos();
+  };
+
+  $("#olderClips").click(loadVideos);
 
   setInterval(updateVideos, 60000);
   updateVideos();
 
-  $.getJSON("settings", function(data)
+  var loadSettings = function()
+  {
+    $.getJSON(cameraUrl("settings"), function(data)
+    {
+      $("#inputEdgeDetectionSeconds").val(data.EdgeDetectionSeconds);
+      $("#inputDebounceSeconds").val(data.DebounceSeconds);
+      $("#inputTriggerDelay").val(data.TriggerDelay);
+      $("#inputTriggerThreshold").val(data.TriggerThreshold);
+      $("#inputAnalysisDecimation").val(data.AnalysisDecimation);
+      $("#inputDetectorMode").val(data.DetectorMode);
+      $("#inputDifferenceScale").val(data.DifferenceScale);
+      $("#inputTriggerMode").val(data.TriggerMode);
+      $("#inputZScoreThreshold").val(data.ZScoreThreshold);
+      $("#inputTileColumns").val(data.TileColumns);
+      $("#inputTileRows").val(data.TileRows);
+      $("#inputBayerMode").val(data.BayerMode);
+      $("#inputWidth").val(data.Width);
+      $("#inputHeight").val(data.Height);
+      $("#inputHugePages").val(data.HugePages);
+      $("#inputRecordingMode").val(data.RecordingMode);
+      $("#inputEncoderProfile").val(data.EncoderProfile);
+      $("#inputCompressionQuality").val(data.CompressionQuality);
+      $("#inputSegmentSeconds").val(data.SegmentSeconds);
+      $("#inputPreviewRate").val(data.PreviewRate);
+      $("#inputPreviewWidth").val(data.PreviewWidth);
+    });
+  };
+
+  $.getJSON("cameras", function(data)
   {
-    $("#inputEdgeDetectionSeconds").val(data.EdgeDetectionSeconds);
-    $("#inputDebounceSeconds").val(data.DebounceSeconds);
-    $("#inputTriggerDelay").val(data.TriggerDelay);
-    $("#inputTriggerThreshold").val(data.TriggerThreshold);
-    $("#inputBayerMode").val(data.BayerMode);
-    $("#inputWidth").val(data.Width);
-    $("#inputHeight").val(data.Height);
+    $.each(data, function(key, val)
+    {
+      $("#camera-select").append($("<option>").val(val.id).text("Camera " + val.id + " (" + val.source + ")"));
+    });
+    $("#camera-select").toggle(data.length > 1);
   });
 
+  $("#camera-select").change(function()
+  {
+    camera = $(this).val();
+    openLive();
+    loadSettings();
+  });
+
+  openLive();
+  loadSettings();
+
   $("#saveSettings").click(function()
   {
-    $.post("settings",
+    $.post(cameraUrl("settings"),
       {
         EdgeDetectionSeconds: $("#inputEdgeDetectionSeconds").val(),
         DebounceSeconds: $("#inputDebounceSeconds").val(),
         TriggerDelay: $("#inputTriggerDelay").val(),
         TriggerThreshold: $("#inputTriggerThreshold").val(),
+        AnalysisDecimation: $("#inputAnalysisDecimation").val(),
+        DetectorMode: $("#inputDetectorMode").val(),
+        DifferenceScale: $("#inputDifferenceScale").val(),
+        TriggerMode: $("#inputTriggerMode").val(),
+        ZScoreThreshold: $("#inputZScoreThreshold").val(),
+        TileColumns: $("#inputTileColumns").val(),
+        TileRows: $("#inputTileRows").val(),
         BayerMode: $("#inputBayerMode").val(),
         Width: $("#inputWidth").val(),
-        Height: $("#inputHeight").val()
+        Height: $("#inputHeight").val(),
+        HugePages: $("#inputHugePages").val(),
+        RecordingMode: $("#inputRecordingMode").val(),
+        EncoderProfile: $("#inputEncoderProfile").val(),
+        CompressionQuality: $("#inputCompressionQuality").val(),
+        SegmentSeconds: $("#inputSegmentSeconds").val(),
+        PreviewRate: $("#inputPreviewRate").val(),
+        PreviewWidth: $("#inputPreviewWidth").val()
       }
     );
   });